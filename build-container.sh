@@ -1,3 +1,13 @@
 #!/bin/sh
 
-docker build -t trilinos_demo -f dockerfiles/trilinos_demo configure-files
+# Usage: ./build-container.sh [<variant>]
+#
+# Without a variant, the image trilinos_demo is built with the default Trilinos
+# configuration. With a variant (e.g. openmp), the image trilinos_demo_<variant> is
+# built with configure-files/do-configure-trilinos-<variant>.sh.
+
+if [ -z "$1" ]; then
+  docker build -t trilinos_demo -f dockerfiles/trilinos_demo configure-files
+else
+  docker build -t trilinos_demo_$1 --build-arg TRILINOS_CONFIGFILE=do-configure-trilinos-$1.sh -f dockerfiles/trilinos_demo configure-files
+fi
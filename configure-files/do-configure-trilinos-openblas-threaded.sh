@@ -0,0 +1,9 @@
+#!/bin/bash
+
+# Optimized BLAS/LAPACK profile: multithreaded (pthreads) OpenBLAS instead of the
+# reference Netlib libraries. The number of BLAS threads is set via
+# OPENBLAS_NUM_THREADS at run time.
+
+BLAS_LIBRARIES=/usr/lib64/libopenblasp.so.0 \
+LAPACK_LIBRARIES=/usr/lib64/libopenblasp.so.0 \
+  `dirname $0`/do-configure-trilinos.sh
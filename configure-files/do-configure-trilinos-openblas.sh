@@ -0,0 +1,8 @@
+#!/bin/bash
+
+# Optimized BLAS/LAPACK profile: single-threaded OpenBLAS instead of the reference
+# Netlib libraries. OpenBLAS also provides LAPACK.
+
+BLAS_LIBRARIES=/usr/lib64/libopenblas.so.0 \
+LAPACK_LIBRARIES=/usr/lib64/libopenblas.so.0 \
+  `dirname $0`/do-configure-trilinos.sh
@@ -0,0 +1,6 @@
+#!/bin/bash
+
+# Multithreaded profile: Kokkos with OpenMP backend, such that the default
+# Tpetra node (and thus all Tpetra, Ifpack2, and Belos kernels) uses OpenMP.
+
+ENABLE_OPENMP=ON `dirname $0`/do-configure-trilinos.sh
@@ -2,6 +2,12 @@
 
 BUILD_TYPE=RELEASE
 
+# Kokkos backends and BLAS/LAPACK libraries; profiles such as
+# do-configure-trilinos-openmp.sh override these
+ENABLE_OPENMP=${ENABLE_OPENMP:-OFF}
+BLAS_LIBRARIES=${BLAS_LIBRARIES:-/usr/lib64/libblas.so.3}
+LAPACK_LIBRARIES=${LAPACK_LIBRARIES:-/usr/lib64/liblapack.so.3}
+
 BASE_DIR=/opt/trilinos/source
 INSTALL_DIR=/opt/trilinos/install
 
@@ -19,10 +25,16 @@ cmake \
     -D Trilinos_ENABLE_ALL_OPTIONAL_PACKAGES:BOOL=OFF \
     -D Trilinos_ENABLE_EXPLICIT_INSTANTIATION:BOOL=ON \
     -D Trilinos_ENABLE_Fortran:BOOL=OFF \
+    -D Trilinos_ENABLE_OpenMP:BOOL=${ENABLE_OPENMP} \
     -D Trilinos_VERBOSE_CONFIGURE:BOOL=OFF \
     \
     -D Trilinos_ENABLE_Amesos2:BOOL=ON \
       -D Amesos2_ENABLE_TESTS:BOOL=ON \
+      -D Amesos2_ENABLE_KLU2:BOOL=ON \
+      -D Amesos2_ENABLE_Basker:BOOL=ON \
+      -D Amesos2_ENABLE_LAPACK:BOOL=ON \
+      -D Amesos2_ENABLE_ShyLU_NodeTacho:BOOL=ON \
+    -D Trilinos_ENABLE_ShyLU_NodeTacho:BOOL=ON \
     -D Trilinos_ENABLE_Belos:BOOL=ON \
       -D Belos_ENABLE_Tpetra:BOOL=ON \
     -D Belos_ENABLE_EXAMPLES:BOOL=ON \
@@ -31,11 +43,22 @@ cmake \
       -D Galeri_ENABLE_Xpetra:BOOL=ON \
       -D Trilinos_ENABLE_Ifpack2:BOOL=ON \
       -D Ifpack2_ENABLE_TESTS:BOOL=OFF \
+    -D Trilinos_ENABLE_MueLu:BOOL=ON \
+      -D MueLu_ENABLE_TESTS:BOOL=OFF \
+    -D Trilinos_ENABLE_Zoltan:BOOL=ON \
+    -D Trilinos_ENABLE_Zoltan2:BOOL=ON \
+      -D Zoltan2_ENABLE_TESTS:BOOL=OFF \
     -D Trilinos_ENABLE_TESTS:BOOL=ON \
     -D Kokkos_ENABLE_SERIAL:BOOL=ON \
+    -D Kokkos_ENABLE_OPENMP:BOOL=${ENABLE_OPENMP} \
     -D Trilinos_ENABLE_Teuchos:BOOL=ON \
+      -D Teuchos_KOKKOS_PROFILING:BOOL=ON \
     -D Trilinos_ENABLE_Tpetra:BOOL=ON \
       -D Tpetra_ENABLE_DEPRECATED_CODE:BOOL=ON \
+      -D Tpetra_INST_DOUBLE:BOOL=ON \
+      -D Tpetra_INST_FLOAT:BOOL=ON \
+      -D Tpetra_INST_SERIAL:BOOL=ON \
+      -D Tpetra_INST_OPENMP:BOOL=${ENABLE_OPENMP} \
     -D Trilinos_ENABLE_Xpetra:BOOL=ON \
       -D Xpetra_ENABLE_Experimental:BOOL=ON \
       -D Xpetra_ENABLE_Kokkos_Refactor:BOOL=ON \
@@ -43,8 +66,11 @@ cmake \
     \
     -D TPL_ENABLE_MPI:BOOL=ON \
     -D TPL_ENABLE_BLAS:BOOL=ON \
-    -D TPL_BLAS_LIBRARIES:FILEPATH=/usr/lib64/libblas.so.3 \
+    -D TPL_BLAS_LIBRARIES:FILEPATH=${BLAS_LIBRARIES} \
     -D TPL_ENABLE_LAPACK:BOOL=ON \
-    -D TPL_LAPACK_LIBRARIES:FILEPATH=/usr/lib64/liblapack.so.3 \
+    -D TPL_LAPACK_LIBRARIES:FILEPATH=${LAPACK_LIBRARIES} \
+    -D TPL_ENABLE_SuperLU:BOOL=ON \
+    -D SuperLU_INCLUDE_DIRS:PATH=/usr/include/SuperLU \
+    -D SuperLU_LIBRARY_DIRS:PATH=/usr/lib64 \
     \
     ${BASE_DIR}
@@ -1,3 +1,7 @@
 #!/bin/sh
 
-docker image rm -f trilinos_demo
+# Usage: ./delete-container.sh [<variant>]
+
+IMAGE=trilinos_demo${1:+_$1}
+
+docker image rm -f $IMAGE
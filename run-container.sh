@@ -1,3 +1,7 @@
 #!/bin/sh
 
-docker run -i -v `pwd`:/opt/trilinos_demo -t trilinos_demo /bin/bash
+# Usage: ./run-container.sh [<variant>]
+
+IMAGE=trilinos_demo${1:+_$1}
+
+docker run -i -v `pwd`:/opt/trilinos_demo -t $IMAGE /bin/bash
@@ -1,12 +1,23 @@
 /* This example shows the very first steps to assemble a linear system in Tpetra.
  */
 
+#include "utils.hpp"
+
+#include <string>
+#include <vector>
+
 #include <Amesos2.hpp>
 
+#include <Kokkos_Core.hpp>
+
 #include <Teuchos_Array.hpp>
 #include <Teuchos_RCP.hpp>
 #include <Teuchos_ScalarTraits.hpp>
+#include <Teuchos_Time.hpp>
+#include <Teuchos_TimeMonitor.hpp>
+#include <Teuchos_VerbosityLevel.hpp>
 
+#include <MatrixMarket_Tpetra.hpp>
 #include <Tpetra_Core.hpp>
 #include <Tpetra_CrsMatrix.hpp>
 #include <Tpetra_Map.hpp>
@@ -31,12 +42,39 @@ int main(int argc, char *argv[]) {
   // Read input parameters from command line
   Teuchos::CommandLineProcessor clp;
   Tpetra::global_size_t numGblIndices = 50; clp.setOption("n", &numGblIndices, "number of nodes / number of global indices (default: 50)");
+  std::string assemblyMode = "global"; clp.setOption("assembly", &assemblyMode, "Assembly mode of the matrix [global, local, kokkos, compare] (default: global)");
+  int numSteps = 0; clp.setOption("numSteps", &numSteps, "Number of re-solves with updated matrix values reusing the symbolic factorization (default: 0)");
+  int numRHS = 1; clp.setOption("numRHS", &numRHS, "Number of right-hand side vectors solved at once in each re-solve (default: 1)");
+  std::string solverName = "Klu"; clp.setOption("solver", &solverName, "Amesos2 direct solver [Klu, Basker, Tacho, SuperLU, SuperLUDist, Lapack, ...] (default: Klu)");
+  std::string verbosity = "auto"; clp.setOption("verbosity", &verbosity, "Verbosity of describe() [auto, none, low, medium, high, extreme]; auto is extreme up to describeThreshold global indices and none above (default: auto)");
+  Tpetra::global_size_t describeThreshold = 1000; clp.setOption("describeThreshold", &describeThreshold, "Maximum number of global indices for describe() output in verbosity mode auto (default: 1000)");
+  std::string outputFormat = "none"; clp.setOption("output", &outputFormat, "Write A, b, and x to file [none, matrixmarket, binary] (default: none)");
+  std::string outputPrefix = "ex_02"; clp.setOption("outputPrefix", &outputPrefix, "Prefix of the output files (default: ex_02)");
+  bool sweepSolvers = false; clp.setOption("sweepSolvers", "noSweepSolvers", &sweepSolvers, "Benchmark all available Amesos2 solvers and print a CSV table (default: off)");
+  std::string timingReport = ""; clp.setOption("timingReport", &timingReport, "YAML file for the timings of all phases (min/mean/max over all ranks) (default: none)");
   switch (clp.parse(argc, argv)) {
     case Teuchos::CommandLineProcessor::PARSE_HELP_PRINTED:        return EXIT_SUCCESS;
     case Teuchos::CommandLineProcessor::PARSE_ERROR:
     case Teuchos::CommandLineProcessor::PARSE_UNRECOGNIZED_OPTION: return EXIT_FAILURE;
     case Teuchos::CommandLineProcessor::PARSE_SUCCESSFUL:          break;
   }
+  if (assemblyMode != "global" && assemblyMode != "local" && assemblyMode != "kokkos" && assemblyMode != "compare") {
+    std::cerr << "Unknown assembly mode '" << assemblyMode << "'." << std::endl;
+    return EXIT_FAILURE;
+  }
+  if (outputFormat != "none" && outputFormat != "matrixmarket" && outputFormat != "binary") {
+    std::cerr << "Unknown output format '" << outputFormat << "'." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Printing with describe() is serialized over all ranks, so it is turned off for large problems by default
+  Teuchos::EVerbosityLevel verbLevel = Teuchos::VERB_NONE;
+  if (verbosity == "auto") {
+    verbLevel = (numGblIndices <= describeThreshold) ? Teuchos::VERB_EXTREME : Teuchos::VERB_NONE;
+  } else if (!getVerbosityLevel(verbosity, verbLevel)) {
+    std::cerr << "Unknown verbosity '" << verbosity << "'." << std::endl;
+    return EXIT_FAILURE;
+  }
 
   // Never create Tpetra objects at main() scope.
   // Never allow them to persist past ScopeGuard's destructor.
@@ -60,13 +98,17 @@ int main(int argc, char *argv[]) {
 
     // Construct a Map that puts approximately the same number of equations
     // on each processor; we start with index 0 (as standard in C++)
-    /* START OF TODO: Create map */
-    const global_ordinal_type indexBase = 0;
-    RCP<const map_type> map = rcp(new map_type(numGblIndices, indexBase, comm));
-    /* END OF TODO: Create map */
+    RCP<const map_type> map = Teuchos::null;
+    {
+      Teuchos::TimeMonitor mapMonitor(*Teuchos::TimeMonitor::getNewCounter("ex_02: Create map"));
+      /* START OF TODO: Create map */
+      const global_ordinal_type indexBase = 0;
+      map = rcp(new map_type(numGblIndices, indexBase, comm));
+      /* END OF TODO: Create map */
+    }
 
     // Print all information about the map (maximum verbosity: VERB_EXTREME)
-    map->describe(*out, Teuchos::VERB_EXTREME);
+    map->describe(*out, verbLevel);
 
     // Get the number of elements owned by the local MPI rank
     const size_t numMyElements = map->getLocalNumElements();
@@ -75,64 +117,139 @@ int main(int argc, char *argv[]) {
     ////////////////////////////////////////////////////////////////////////////
     if (verbose) *out << "\n>> II. Create, fill, and print sparse matrix (Tpetra CrsMatrix)\n" << std::endl;
 
-    // Create a Tpetra sparse matrix whose rows have distribution given by
-    // the Map. We expect at most three entries per row.
-    /* START OF TODO: Create empty matrix */
-    RCP<crs_matrix_type> A = rcp(new crs_matrix_type (map, 3));
-    /* END OF TODO: Create empty matrix */
-
-    // We did not specify a column map => We will assemble using global
-    // indices and let Trilinos create the column map for us when calling fillComplete().
-    // Hence, we need to insert values using global indices (which is convenient but slow).
-
-    // Fill the sparse matrix, one row at a time.
-    const scalar_type two = static_cast<scalar_type>(2.0);
-    const scalar_type negOne = static_cast<scalar_type>(-1.0);
-    for (local_ordinal_type lclRow = 0; lclRow < static_cast<local_ordinal_type>(numMyElements); ++lclRow) {
-      // Convert local index to global index
-      /* START OF TODO: convert local to global index */
-      const global_ordinal_type gblRow = map->getGlobalElement(lclRow);
-      /* END OF TODO: convert local to global index */
-
-      // A(0, 0:1) = [2, -1]
-      if (gblRow == 0) {
-        /* START OF TODO: Fill first row */
-        A->insertGlobalValues(gblRow,
-          tuple<global_ordinal_type>(gblRow, gblRow + 1),
-          tuple<scalar_type>(two, negOne));
-        /* END OF TODO: Fill first row */
+    RCP<crs_matrix_type> A = Teuchos::null;
+    // The timers are registered with Teuchos::TimeMonitor to be included in its summary
+    Teuchos::Time& globalAssemblyTimer = *Teuchos::TimeMonitor::getNewCounter("ex_02: Assembly with global indices");
+    Teuchos::Time& localAssemblyTimer = *Teuchos::TimeMonitor::getNewCounter("ex_02: Assembly with local indices");
+    Teuchos::Time& kokkosAssemblyTimer = *Teuchos::TimeMonitor::getNewCounter("ex_02: Assembly with Kokkos");
+
+    if (assemblyMode == "global" || assemblyMode == "compare") {
+      comm->barrier();
+      globalAssemblyTimer.start(true);
+
+      // Create a Tpetra sparse matrix whose rows have distribution given by
+      // the Map. We expect at most three entries per row.
+      /* START OF TODO: Create empty matrix */
+      A = rcp(new crs_matrix_type (map, 3));
+      /* END OF TODO: Create empty matrix */
+
+      // We did not specify a column map => We will assemble using global
+      // indices and let Trilinos create the column map for us when calling fillComplete().
+      // Hence, we need to insert values using global indices (which is convenient but slow).
+
+      // Fill the sparse matrix, one row at a time.
+      const scalar_type two = static_cast<scalar_type>(2.0);
+      const scalar_type negOne = static_cast<scalar_type>(-1.0);
+      for (local_ordinal_type lclRow = 0; lclRow < static_cast<local_ordinal_type>(numMyElements); ++lclRow) {
+        // Convert local index to global index
+        /* START OF TODO: convert local to global index */
+        const global_ordinal_type gblRow = map->getGlobalElement(lclRow);
+        /* END OF TODO: convert local to global index */
+
+        // A(0, 0:1) = [2, -1]
+        if (gblRow == 0) {
+          /* START OF TODO: Fill first row */
+          A->insertGlobalValues(gblRow,
+            tuple<global_ordinal_type>(gblRow, gblRow + 1),
+            tuple<scalar_type>(two, negOne));
+          /* END OF TODO: Fill first row */
+        }
+        // A(N-1, N-2:N-1) = [-1, 2]
+        else if (static_cast<Tpetra::global_size_t>(gblRow) == numGblIndices - 1) {
+          /* START OF TODO: Fill last row */
+          A->insertGlobalValues(gblRow,
+            tuple<global_ordinal_type>(gblRow - 1, gblRow),
+            tuple<scalar_type>(negOne, two));
+          /* END OF TODO: Fill last row */
+        }
+        // A(i, i-1:i+1) = [-1, 2, -1]
+        else {
+          /* START OF TODO: Fill intermediate rows */
+          A->insertGlobalValues(gblRow,
+            tuple<global_ordinal_type>(gblRow - 1, gblRow, gblRow + 1),
+            tuple<scalar_type>(negOne, two, negOne));
+          /* END OF TODO: Fill intermediate rows */
+        }
+      }
+
+      // Tell the sparse matrix that we are done adding entries to it. For
+      // completeness, we specify the domain and range maps (here, both are
+      // the map created before).
+      {
+        Teuchos::TimeMonitor fillCompleteMonitor(getFillCompleteTimer());
+        /* START OF TODO: Fill complete */
+        A->fillComplete(map, map);
+        /* END OF TODO: Fill complete */
       }
-      // A(N-1, N-2:N-1) = [-1, 2]
-      else if (static_cast<Tpetra::global_size_t>(gblRow) == numGblIndices - 1) {
-        /* START OF TODO: Fill last row */
-        A->insertGlobalValues(gblRow,
-          tuple<global_ordinal_type>(gblRow - 1, gblRow),
-          tuple<scalar_type>(negOne, two));
-        /* END OF TODO: Fill last row */
+
+      globalAssemblyTimer.stop();
+    }
+
+    // Alternatively, create row and column map up front and assemble the matrix on a
+    // static graph using local indices only (see utils.hpp).
+    if (assemblyMode == "local" || assemblyMode == "compare") {
+      RCP<crs_matrix_type> globalA = A;
+
+      comm->barrier();
+      localAssemblyTimer.start(true);
+      A = assembleMatrixLocal(map);
+      localAssemblyTimer.stop();
+
+      // Both assembly modes have to yield the same matrix
+      if (!globalA.is_null()) {
+        const auto globalNorm = globalA->getFrobeniusNorm();
+        const auto localNorm = A->getFrobeniusNorm();
+        if (verbose) *out << "Frobenius norm of A (global / local assembly): " << globalNorm
+            << " / " << localNorm << std::endl;
       }
-      // A(i, i-1:i+1) = [-1, 2, -1]
-      else {
-        /* START OF TODO: Fill intermediate rows */
-        A->insertGlobalValues(gblRow,
-          tuple<global_ordinal_type>(gblRow - 1, gblRow, gblRow + 1),
-          tuple<scalar_type>(negOne, two, negOne));
-        /* END OF TODO: Fill intermediate rows */
+    }
+
+    // Or build the local CRS arrays in parallel with Kokkos and create the matrix
+    // directly from the resulting KokkosSparse::CrsMatrix (see utils.hpp).
+    if (assemblyMode == "kokkos" || assemblyMode == "compare") {
+      RCP<crs_matrix_type> previousA = A;
+
+      if (verbose) *out << "Kokkos execution space: " << Kokkos::DefaultExecutionSpace::name()
+          << " (concurrency: " << Kokkos::DefaultExecutionSpace().concurrency() << ")" << std::endl;
+
+      comm->barrier();
+      kokkosAssemblyTimer.start(true);
+      A = assembleMatrixKokkos(map);
+      kokkosAssemblyTimer.stop();
+
+      if (!previousA.is_null()) {
+        const auto previousNorm = previousA->getFrobeniusNorm();
+        const auto kokkosNorm = A->getFrobeniusNorm();
+        if (verbose) *out << "Frobenius norm of A (local / Kokkos assembly): " << previousNorm
+            << " / " << kokkosNorm << std::endl;
       }
     }
 
-    // Tell the sparse matrix that we are done adding entries to it. For
-    // completeness, we specify the domain and range maps (here, both are
-    // the map created before).
-    /* START OF TODO: Fill complete */
-    A->fillComplete(map, map);
-    /* END OF TODO: Fill complete */
+    // Report the assembly times (maximum over all ranks)
+    {
+      const double globalTime = getMaxTime(globalAssemblyTimer, *comm);
+      const double localTime = getMaxTime(localAssemblyTimer, *comm);
+      const double kokkosTime = getMaxTime(kokkosAssemblyTimer, *comm);
+      if (verbose) {
+        if (assemblyMode == "global" || assemblyMode == "compare")
+          *out << "Assembly time with global indices: " << globalTime << " s" << std::endl;
+        if (assemblyMode == "local" || assemblyMode == "compare")
+          *out << "Assembly time with local indices:  " << localTime << " s" << std::endl;
+        if (assemblyMode == "kokkos" || assemblyMode == "compare")
+          *out << "Assembly time with Kokkos:         " << kokkosTime << " s" << std::endl;
+        if (assemblyMode == "compare") {
+          *out << "Speedup of local over global assembly on " << numProcs << " ranks:  " << globalTime / localTime << std::endl;
+          *out << "Speedup of Kokkos over global assembly on " << numProcs << " ranks: " << globalTime / kokkosTime << std::endl;
+        }
+      }
+    }
 
     // If matrix->fillComplete(); would be called instead (no arguments), the
     // same would happen since Trilinos would automatically use the row map
     // as domain and range ma
     // Print all information about the matrix (maximum verbosity:
     // VERB_EXTREME)
-    A->describe(*out, Teuchos::VERB_EXTREME);
+    A->describe(*out, verbLevel);
 
     ////////////////////////////////////////////////////////////////////////////
     ////////////////////////////////////////////////////////////////////////////
@@ -147,18 +264,144 @@ int main(int argc, char *argv[]) {
     b->putScalar(Teuchos::ScalarTraits<scalar_type>::one());
     /* END OF TODO: Fill right-hand side */
 
-    b->describe(*out, Teuchos::VERB_EXTREME);
+    b->describe(*out, verbLevel);
 
     ////////////////////////////////////////////////////////////////////////////
     ////////////////////////////////////////////////////////////////////////////
     if (verbose) *out << "\n>> IV. Solve the system and print the right hand side (Tpetra Vector)\n" << std::endl;
 
-    auto solver = Amesos2::create<crs_matrix_type, multivec_type>("Klu", A, x, b);
+    Teuchos::Time& symbolicTimer = *Teuchos::TimeMonitor::getNewCounter("ex_02: Symbolic factorization");
+    Teuchos::Time& numericTimer = *Teuchos::TimeMonitor::getNewCounter("ex_02: Numeric factorization");
+    Teuchos::Time& solveTimer = *Teuchos::TimeMonitor::getNewCounter("ex_02: Solve");
+
+    if (!Amesos2::query(solverName)) {
+      if (verbose) *out << "Amesos2 solver '" << solverName << "' is not available in this Trilinos installation." << std::endl;
+      return EXIT_FAILURE;
+    }
+    if (verbose) *out << "Amesos2 solver: " << solverName << std::endl;
+
+    auto solver = Amesos2::create<crs_matrix_type, multivec_type>(solverName, A, x, b);
+    symbolicTimer.start(true);
     solver->symbolicFactorization();
+    symbolicTimer.stop();
+    numericTimer.start(true);
     solver->numericFactorization();
+    numericTimer.stop();
+    solveTimer.start(true);
     solver->solve();
+    solveTimer.stop();
+
+    x->describe(*out, verbLevel);
+
+    // Write the linear system and its solution to file for inspection
+    if (outputFormat != "none") {
+      // Registered with Teuchos::TimeMonitor to be included in its summary and the YAML report
+      static Teuchos::Time& writeTimer = *Teuchos::TimeMonitor::getNewCounter("ex_02: Write output");
+      comm->barrier();
+      writeTimer.start(true);
+      if (outputFormat == "matrixmarket") {
+        // Data is gathered on rank 0, which writes a single file per object
+        using writer_type = Tpetra::MatrixMarket::Writer<crs_matrix_type>;
+        writer_type::writeSparseFile(outputPrefix + "_A.mtx", A);
+        writer_type::writeDenseFile(outputPrefix + "_b.mtx", b);
+        writer_type::writeDenseFile(outputPrefix + "_x.mtx", x);
+      } else {
+        // All ranks write their local data concurrently, one file per rank and object
+        writeMatrixBinary(outputPrefix + "_A", *A);
+        writeVectorBinary(outputPrefix + "_b", *b);
+        writeVectorBinary(outputPrefix + "_x", *x);
+      }
+      writeTimer.stop();
+      const double writeTime = getMaxTime(writeTimer, *comm);
+      if (verbose) *out << "Wrote A, b, and x in " << outputFormat << " format with prefix '" << outputPrefix
+          << "' in " << writeTime << " s" << std::endl;
+    }
+
+    ////////////////////////////////////////////////////////////////////////////
+    ////////////////////////////////////////////////////////////////////////////
+    if (numSteps > 0) {
+      if (verbose) *out << "\n>> V. Re-solve " << numSteps << " times with updated matrix values and "
+          << numRHS << " right-hand side(s)\n" << std::endl;
+
+      // Block of right-hand sides and solutions, solved with a single call to solve()
+      RCP<multivec_type> X = rcp(new multivec_type(A->getDomainMap(), numRHS));
+      RCP<multivec_type> B = rcp(new multivec_type(A->getRangeMap(), numRHS));
+
+      for (int step = 1; step <= numSteps; ++step) {
+        // Update the matrix values in place. The sparsity pattern does not change,
+        // so the solver keeps its symbolic factorization and only the numeric
+        // factorization has to be recomputed.
+        updateMatrixValues(*A, step);
+        solver->setA(A, Amesos2::SYMBFACT);
+
+        numericTimer.start(false);
+        solver->numericFactorization();
+        numericTimer.stop();
+
+        B->randomize();
+        solveTimer.start(false);
+        solver->solve(Teuchos::outArg(*X), Teuchos::ptrInArg(*B));
+        solveTimer.stop();
+      }
+    }
+
+    // Report how the time splits between the phases of the direct solver (maximum over all ranks)
+    {
+      const double symbolicTime = getMaxTime(symbolicTimer, *comm);
+      const double numericTime = getMaxTime(numericTimer, *comm);
+      const double solveTime = getMaxTime(solveTimer, *comm);
+      const double totalTime = symbolicTime + numericTime + solveTime;
+      if (verbose) {
+        *out << "Symbolic factorization: " << symbolicTime << " s (1 call, "
+            << 100.0 * symbolicTime / totalTime << " %)" << std::endl;
+        *out << "Numeric factorization:  " << numericTime << " s (" << numSteps + 1 << " calls, "
+            << 100.0 * numericTime / totalTime << " %)" << std::endl;
+        *out << "Solve:                  " << solveTime << " s (" << numSteps + 1 << " calls, "
+            << 1 + numSteps * numRHS << " right-hand sides, " << 100.0 * solveTime / totalTime << " %)" << std::endl;
+      }
+    }
+
+    ////////////////////////////////////////////////////////////////////////////
+    ////////////////////////////////////////////////////////////////////////////
+    if (sweepSolvers) {
+      if (verbose) *out << "\n>> VI. Benchmark all available Amesos2 solvers\n" << std::endl;
+
+      // Candidates; only those compiled into the Trilinos installation are benchmarked
+      const std::vector<std::string> solverNames = {"KLU2", "Basker", "ShyLUBasker", "Tacho", "SuperLU",
+        "SuperLUMT", "SuperLUDist", "Umfpack", "Cholmod", "MUMPS", "PardisoMKL", "Lapack"};
+
+      if (verbose) *out << "solver,ranks,n,factorization time [s],solve time [s],peak memory [MB],relative residual" << std::endl;
+      for (const std::string& name : solverNames) {
+        if (!Amesos2::query(name)) continue;
+
+        RCP<vec_type> xSweep = rcp(new vec_type(A->getDomainMap()));
+        Teuchos::Time factorizationTimer("Factorization");
+        Teuchos::Time sweepSolveTimer("Solve");
+
+        resetPeakMemory();
+        comm->barrier();
+        auto sweepSolver = Amesos2::create<crs_matrix_type, multivec_type>(name, A, xSweep, b);
+        factorizationTimer.start(true);
+        sweepSolver->symbolicFactorization();
+        sweepSolver->numericFactorization();
+        factorizationTimer.stop();
+        sweepSolveTimer.start(true);
+        sweepSolver->solve();
+        sweepSolveTimer.stop();
+
+        const double factorizationTime = getMaxTime(factorizationTimer, *comm);
+        const double sweepSolveTime = getMaxTime(sweepSolveTimer, *comm);
+        const double peakMemory = getMaxPeakMemory(*comm);
+        const scalar_type residual = computeRelativeResidual(*A, *xSweep, *b);
+        if (verbose) *out << name << "," << numProcs << "," << numGblIndices << "," << factorizationTime << ","
+            << sweepSolveTime << "," << peakMemory << "," << residual << std::endl;
+      }
+    }
 
-    x->describe(*out, Teuchos::VERB_EXTREME);
+    // Timings of all phases (minimum, mean and maximum over all ranks)
+    if (verbose) *out << std::endl;
+    Teuchos::TimeMonitor::summarize(comm.ptr(), *out, false, true, false);
+    if (!timingReport.empty()) writeTimingReport(timingReport, comm);
 
     return EXIT_SUCCESS;
   }
@@ -0,0 +1,397 @@
+#ifndef _UTILS_
+#define _UTILS_
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <Kokkos_Core.hpp>
+
+#include <Teuchos_Array.hpp>
+#include <Teuchos_Comm.hpp>
+#include <Teuchos_CommHelpers.hpp>
+#include <Teuchos_OrdinalTraits.hpp>
+#include <Teuchos_RCP.hpp>
+#include <Teuchos_Time.hpp>
+#include <Teuchos_TimeMonitor.hpp>
+#include <Teuchos_VerbosityLevel.hpp>
+
+#include <Tpetra_CrsGraph.hpp>
+#include <Tpetra_CrsMatrix.hpp>
+#include <Tpetra_Map.hpp>
+#include <Tpetra_Vector.hpp>
+
+using Scalar = Tpetra::CrsMatrix<>::scalar_type;
+using LocalOrdinal = Tpetra::CrsMatrix<>::local_ordinal_type;
+using GlobalOrdinal = Tpetra::CrsMatrix<>::global_ordinal_type;
+using Node = Tpetra::CrsMatrix<>::node_type;
+
+using Teuchos::RCP;
+using Teuchos::rcp;
+
+// Return the maximum of the timer's elapsed time over all ranks
+double getMaxTime(const Teuchos::Time& timer, const Teuchos::Comm<int>& comm)
+{
+  const double lclTime = timer.totalElapsedTime();
+  double gblTime = 0.0;
+  Teuchos::reduceAll<int, double>(comm, Teuchos::REDUCE_MAX, lclTime, Teuchos::outArg(gblTime));
+  return gblTime;
+}
+
+// Counter of all fillComplete() calls. It is registered with Teuchos::TimeMonitor on the
+// first call only, since the assembly functions may be called repeatedly.
+Teuchos::Time& getFillCompleteTimer()
+{
+  static RCP<Teuchos::Time> timer = Teuchos::TimeMonitor::getNewCounter("ex_02: fillComplete");
+  return *timer;
+}
+
+// Translate a verbosity name into a Teuchos verbosity level; returns false for unknown names
+bool getVerbosityLevel(const std::string& name, Teuchos::EVerbosityLevel& verbLevel)
+{
+  if      (name == "none")    verbLevel = Teuchos::VERB_NONE;
+  else if (name == "low")     verbLevel = Teuchos::VERB_LOW;
+  else if (name == "medium")  verbLevel = Teuchos::VERB_MEDIUM;
+  else if (name == "high")    verbLevel = Teuchos::VERB_HIGH;
+  else if (name == "extreme") verbLevel = Teuchos::VERB_EXTREME;
+  else return false;
+  return true;
+}
+
+// Reset the peak resident set size of this process (Linux only, no-op elsewhere)
+void resetPeakMemory()
+{
+  std::ofstream clearRefs("/proc/self/clear_refs");
+  if (clearRefs) clearRefs << "5";
+}
+
+// Return the maximum over all ranks of the peak resident set size in MB (Linux only)
+double getMaxPeakMemory(const Teuchos::Comm<int>& comm)
+{
+  double lclPeak = 0.0;
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  while (std::getline(status, line)) {
+    if (line.compare(0, 6, "VmHWM:") == 0) {
+      std::istringstream(line.substr(6)) >> lclPeak;
+      lclPeak /= 1024.0;
+      break;
+    }
+  }
+  double gblPeak = 0.0;
+  Teuchos::reduceAll<int, double>(comm, Teuchos::REDUCE_MAX, lclPeak, Teuchos::outArg(gblPeak));
+  return gblPeak;
+}
+
+// Return the relative residual ||b - A*x|| / ||b||
+Scalar computeRelativeResidual(const Tpetra::CrsMatrix<Scalar,LocalOrdinal,GlobalOrdinal,Node>& A,
+    const Tpetra::Vector<Scalar,LocalOrdinal,GlobalOrdinal,Node>& x,
+    const Tpetra::Vector<Scalar,LocalOrdinal,GlobalOrdinal,Node>& b)
+{
+  Tpetra::Vector<Scalar,LocalOrdinal,GlobalOrdinal,Node> r(b.getMap());
+  A.apply(x, r);
+  r.update(Teuchos::ScalarTraits<Scalar>::one(), b, -Teuchos::ScalarTraits<Scalar>::one());
+  return r.norm2() / b.norm2();
+}
+
+/* Build the column map of the tridiagonal matrix for a contiguous row map.
+ *
+ * The locally owned indices come first (in the order of the row map), such that
+ * the local column index of an owned entry equals its local row index. They are
+ * followed by the ghost index of the left neighbor and the ghost index of the
+ * right neighbor (if present).
+ */
+RCP<const Tpetra::Map<LocalOrdinal,GlobalOrdinal,Node>>
+buildColumnMap(RCP<const Tpetra::Map<LocalOrdinal,GlobalOrdinal,Node>> rowMap)
+{
+  using map_type = Tpetra::Map<LocalOrdinal,GlobalOrdinal,Node>;
+
+  const size_t numMyElements = rowMap->getLocalNumElements();
+  const GlobalOrdinal indexBase = rowMap->getIndexBase();
+  const GlobalOrdinal gblLastIndex = indexBase + static_cast<GlobalOrdinal>(rowMap->getGlobalNumElements()) - 1;
+
+  Teuchos::Array<GlobalOrdinal> colIndices;
+  colIndices.reserve(numMyElements + 2);
+  for (LocalOrdinal lclRow = 0; lclRow < static_cast<LocalOrdinal>(numMyElements); ++lclRow)
+    colIndices.push_back(rowMap->getGlobalElement(lclRow));
+
+  if (numMyElements > 0) {
+    if (rowMap->getMinGlobalIndex() > indexBase) colIndices.push_back(rowMap->getMinGlobalIndex() - 1);
+    if (rowMap->getMaxGlobalIndex() < gblLastIndex) colIndices.push_back(rowMap->getMaxGlobalIndex() + 1);
+  }
+
+  return rcp(new map_type(Teuchos::OrdinalTraits<Tpetra::global_size_t>::invalid(),
+      colIndices(), indexBase, rowMap->getComm()));
+}
+
+/* Assemble the tridiagonal matrix [-1, 2, -1] using local indices only.
+ *
+ * Row and column map are known up front, so the graph can be allocated with the
+ * exact number of entries per row and completed once. The matrix is then created
+ * on this static graph and its values are replaced row by row using local indices.
+ * In contrast to insertGlobalValues(), this avoids any global-to-local index
+ * conversion as well as sorting and merging of entries in fillComplete().
+ */
+RCP<Tpetra::CrsMatrix<Scalar,LocalOrdinal,GlobalOrdinal,Node>>
+assembleMatrixLocal(RCP<const Tpetra::Map<LocalOrdinal,GlobalOrdinal,Node>> rowMap)
+{
+  using crs_graph_type = Tpetra::CrsGraph<LocalOrdinal,GlobalOrdinal,Node>;
+  using crs_matrix_type = Tpetra::CrsMatrix<Scalar,LocalOrdinal,GlobalOrdinal,Node>;
+
+  RCP<const Tpetra::Map<LocalOrdinal,GlobalOrdinal,Node>> colMap = buildColumnMap(rowMap);
+
+  const LocalOrdinal numMyElements = static_cast<LocalOrdinal>(rowMap->getLocalNumElements());
+  const GlobalOrdinal indexBase = rowMap->getIndexBase();
+  const GlobalOrdinal gblLastIndex = indexBase + static_cast<GlobalOrdinal>(rowMap->getGlobalNumElements()) - 1;
+
+  // Local column indices of the left and right ghost entries (see buildColumnMap())
+  const bool hasLeftGhost = (numMyElements > 0) && (rowMap->getMinGlobalIndex() > indexBase);
+  const bool hasRightGhost = (numMyElements > 0) && (rowMap->getMaxGlobalIndex() < gblLastIndex);
+  const LocalOrdinal lclLeftGhost = numMyElements;
+  const LocalOrdinal lclRightGhost = numMyElements + (hasLeftGhost ? 1 : 0);
+
+  // Count the exact number of entries per row: 2 in the first and last global row, 3 otherwise
+  Teuchos::Array<size_t> numEntPerRow(numMyElements, 3);
+  for (LocalOrdinal lclRow = 0; lclRow < numMyElements; ++lclRow) {
+    const GlobalOrdinal gblRow = rowMap->getGlobalElement(lclRow);
+    if (gblRow == indexBase || gblRow == gblLastIndex) numEntPerRow[lclRow] = 2;
+  }
+
+  // Create and complete the graph using local column indices
+  RCP<crs_graph_type> graph = rcp(new crs_graph_type(rowMap, colMap, numEntPerRow().getConst()));
+  for (LocalOrdinal lclRow = 0; lclRow < numMyElements; ++lclRow) {
+    const LocalOrdinal left = (lclRow > 0) ? lclRow - 1 : lclLeftGhost;
+    const LocalOrdinal right = (lclRow < numMyElements - 1) ? lclRow + 1 : lclRightGhost;
+    const bool hasLeft = (lclRow > 0) || hasLeftGhost;
+    const bool hasRight = (lclRow < numMyElements - 1) || hasRightGhost;
+
+    LocalOrdinal cols[3];
+    LocalOrdinal numEnt = 0;
+    if (hasLeft) cols[numEnt++] = left;
+    cols[numEnt++] = lclRow;
+    if (hasRight) cols[numEnt++] = right;
+    graph->insertLocalIndices(lclRow, numEnt, cols);
+  }
+  {
+    Teuchos::TimeMonitor fillCompleteMonitor(getFillCompleteTimer());
+    graph->fillComplete(rowMap, rowMap);
+  }
+
+  // Create the matrix on the static graph and set its values using local indices
+  RCP<crs_matrix_type> A = rcp(new crs_matrix_type(graph));
+
+  const Scalar two = static_cast<Scalar>(2.0);
+  const Scalar negOne = static_cast<Scalar>(-1.0);
+  for (LocalOrdinal lclRow = 0; lclRow < numMyElements; ++lclRow) {
+    const LocalOrdinal left = (lclRow > 0) ? lclRow - 1 : lclLeftGhost;
+    const LocalOrdinal right = (lclRow < numMyElements - 1) ? lclRow + 1 : lclRightGhost;
+    const bool hasLeft = (lclRow > 0) || hasLeftGhost;
+    const bool hasRight = (lclRow < numMyElements - 1) || hasRightGhost;
+
+    LocalOrdinal cols[3];
+    Scalar vals[3];
+    LocalOrdinal numEnt = 0;
+    if (hasLeft) { cols[numEnt] = left; vals[numEnt++] = negOne; }
+    cols[numEnt] = lclRow; vals[numEnt++] = two;
+    if (hasRight) { cols[numEnt] = right; vals[numEnt++] = negOne; }
+    A->replaceLocalValues(lclRow, numEnt, vals, cols);
+  }
+  {
+    Teuchos::TimeMonitor fillCompleteMonitor(getFillCompleteTimer());
+    A->fillComplete(rowMap, rowMap);
+  }
+
+  return A;
+}
+
+/* Assemble the tridiagonal matrix [-1, 2, -1] with Kokkos.
+ *
+ * The row offsets are computed with a parallel_scan over the local rows, the column
+ * indices and values are filled with a parallel_for on the default execution space.
+ * The matrix is then created from the resulting KokkosSparse::CrsMatrix. Since the
+ * entries of each row are already sorted by local column index, the matrix is fill
+ * complete right away without any sorting or merging of entries.
+ *
+ * The row map needs to be contiguous.
+ */
+RCP<Tpetra::CrsMatrix<Scalar,LocalOrdinal,GlobalOrdinal,Node>>
+assembleMatrixKokkos(RCP<const Tpetra::Map<LocalOrdinal,GlobalOrdinal,Node>> rowMap)
+{
+  using crs_matrix_type = Tpetra::CrsMatrix<Scalar,LocalOrdinal,GlobalOrdinal,Node>;
+  using local_matrix_type = typename crs_matrix_type::local_matrix_device_type;
+  using execution_space = typename local_matrix_type::execution_space;
+  using range_policy = Kokkos::RangePolicy<execution_space>;
+
+  using row_offsets_type = typename local_matrix_type::row_map_type::non_const_type;
+  using col_indices_type = typename local_matrix_type::index_type::non_const_type;
+  using values_type = typename local_matrix_type::values_type::non_const_type;
+  using offset_type = typename row_offsets_type::non_const_value_type;
+
+  RCP<const Tpetra::Map<LocalOrdinal,GlobalOrdinal,Node>> colMap = buildColumnMap(rowMap);
+
+  const LocalOrdinal numMyElements = static_cast<LocalOrdinal>(rowMap->getLocalNumElements());
+  const LocalOrdinal numMyColumns = static_cast<LocalOrdinal>(colMap->getLocalNumElements());
+  const GlobalOrdinal indexBase = rowMap->getIndexBase();
+  const GlobalOrdinal gblLastIndex = indexBase + static_cast<GlobalOrdinal>(rowMap->getGlobalNumElements()) - 1;
+  const GlobalOrdinal gblFirstRow = (numMyElements > 0) ? rowMap->getMinGlobalIndex() : indexBase;
+
+  // Local column indices of the left and right ghost entries (see buildColumnMap())
+  const bool hasLeftGhost = (numMyElements > 0) && (rowMap->getMinGlobalIndex() > indexBase);
+  const bool hasRightGhost = (numMyElements > 0) && (rowMap->getMaxGlobalIndex() < gblLastIndex);
+  const LocalOrdinal lclLeftGhost = numMyElements;
+  const LocalOrdinal lclRightGhost = numMyElements + (hasLeftGhost ? 1 : 0);
+
+  // Row offsets: 2 entries in the first and last global row, 3 otherwise
+  row_offsets_type rowOffsets(Kokkos::view_alloc(Kokkos::WithoutInitializing, "row offsets"), numMyElements + 1);
+  Kokkos::parallel_scan("ex_02::rowOffsets", range_policy(0, numMyElements + 1),
+    KOKKOS_LAMBDA(const LocalOrdinal lclRow, offset_type& update, const bool final) {
+      if (final) rowOffsets(lclRow) = update;
+      if (lclRow < numMyElements) {
+        const GlobalOrdinal gblRow = gblFirstRow + lclRow;
+        update += (gblRow == indexBase || gblRow == gblLastIndex) ? 2 : 3;
+      }
+    });
+
+  offset_type numMyEntries = 0;
+  Kokkos::deep_copy(numMyEntries, Kokkos::subview(rowOffsets, numMyElements));
+
+  // Column indices and values, each row sorted by local column index
+  col_indices_type colIndices(Kokkos::view_alloc(Kokkos::WithoutInitializing, "column indices"), numMyEntries);
+  values_type values(Kokkos::view_alloc(Kokkos::WithoutInitializing, "values"), numMyEntries);
+
+  const Scalar two = static_cast<Scalar>(2.0);
+  const Scalar negOne = static_cast<Scalar>(-1.0);
+  Kokkos::parallel_for("ex_02::fill", range_policy(0, numMyElements),
+    KOKKOS_LAMBDA(const LocalOrdinal lclRow) {
+      const bool hasLeft = (lclRow > 0) || hasLeftGhost;
+      const bool hasRight = (lclRow < numMyElements - 1) || hasRightGhost;
+
+      LocalOrdinal cols[3];
+      Scalar vals[3];
+      LocalOrdinal numEnt = 0;
+      if (hasLeft) { cols[numEnt] = (lclRow > 0) ? lclRow - 1 : lclLeftGhost; vals[numEnt++] = negOne; }
+      cols[numEnt] = lclRow; vals[numEnt++] = two;
+      if (hasRight) { cols[numEnt] = (lclRow < numMyElements - 1) ? lclRow + 1 : lclRightGhost; vals[numEnt++] = negOne; }
+
+      // Ghost columns come after all owned columns, so the left ghost may be out of order
+      for (LocalOrdinal i = 1; i < numEnt; ++i) {
+        for (LocalOrdinal j = i; j > 0 && cols[j - 1] > cols[j]; --j) {
+          const LocalOrdinal tmpCol = cols[j]; cols[j] = cols[j - 1]; cols[j - 1] = tmpCol;
+          const Scalar tmpVal = vals[j]; vals[j] = vals[j - 1]; vals[j - 1] = tmpVal;
+        }
+      }
+
+      const offset_type offset = rowOffsets(lclRow);
+      for (LocalOrdinal i = 0; i < numEnt; ++i) {
+        colIndices(offset + i) = cols[i];
+        values(offset + i) = vals[i];
+      }
+    });
+
+  local_matrix_type lclMatrix("A", numMyElements, numMyColumns, numMyEntries, values, rowOffsets, colIndices);
+
+  // This constructor calls fillComplete() internally
+  Teuchos::TimeMonitor fillCompleteMonitor(getFillCompleteTimer());
+  return rcp(new crs_matrix_type(lclMatrix, rowMap, colMap, rowMap, rowMap));
+}
+
+/* Update the values of a fill complete matrix in place without changing its graph.
+ *
+ * The diagonal entries are set to 2 * (1 + 0.1 * step) using local indices. This
+ * mimics a sequence of systems with the same sparsity pattern but changing
+ * coefficients (e.g. in time stepping).
+ */
+void updateMatrixValues(Tpetra::CrsMatrix<Scalar,LocalOrdinal,GlobalOrdinal,Node>& A, const int step)
+{
+  const Scalar diag = static_cast<Scalar>(2.0 * (1.0 + 0.1 * step));
+  const auto rowMap = A.getRowMap();
+  const auto colMap = A.getColMap();
+
+  A.resumeFill();
+  for (LocalOrdinal lclRow = 0; lclRow < static_cast<LocalOrdinal>(rowMap->getLocalNumElements()); ++lclRow) {
+    const LocalOrdinal lclCol = colMap->getLocalElement(rowMap->getGlobalElement(lclRow));
+    A.replaceLocalValues(lclRow, 1, &diag, &lclCol);
+  }
+  A.fillComplete(A.getDomainMap(), A.getRangeMap());
+}
+
+// Name of the per-rank binary file <prefix>.<rank>.bin
+std::string getRankFileName(const std::string& prefix, const Teuchos::Comm<int>& comm)
+{
+  return prefix + "." + std::to_string(comm.getRank()) + ".bin";
+}
+
+/* Write the local part of a fill complete matrix to a per-rank binary file.
+ *
+ * Layout: number of local rows, number of local entries, global row indices,
+ * row offsets, global column indices, values. Since no data is communicated,
+ * all ranks write concurrently.
+ */
+void writeMatrixBinary(const std::string& prefix, const Tpetra::CrsMatrix<Scalar,LocalOrdinal,GlobalOrdinal,Node>& A)
+{
+  const auto rowMap = A.getRowMap();
+  const auto colMap = A.getColMap();
+  const auto lclMatrix = A.getLocalMatrixHost();
+
+  const size_t numRows = lclMatrix.numRows();
+  const size_t numEntries = lclMatrix.nnz();
+
+  std::vector<GlobalOrdinal> gblRows(numRows);
+  for (size_t lclRow = 0; lclRow < numRows; ++lclRow)
+    gblRows[lclRow] = rowMap->getGlobalElement(lclRow);
+
+  std::vector<size_t> rowOffsets(numRows + 1);
+  for (size_t lclRow = 0; lclRow <= numRows; ++lclRow)
+    rowOffsets[lclRow] = lclMatrix.graph.row_map(lclRow);
+
+  std::vector<GlobalOrdinal> gblCols(numEntries);
+  for (size_t k = 0; k < numEntries; ++k)
+    gblCols[k] = colMap->getGlobalElement(lclMatrix.graph.entries(k));
+
+  std::ofstream file(getRankFileName(prefix, *rowMap->getComm()), std::ios::binary);
+  file.write(reinterpret_cast<const char*>(&numRows), sizeof(size_t));
+  file.write(reinterpret_cast<const char*>(&numEntries), sizeof(size_t));
+  file.write(reinterpret_cast<const char*>(gblRows.data()), numRows * sizeof(GlobalOrdinal));
+  file.write(reinterpret_cast<const char*>(rowOffsets.data()), (numRows + 1) * sizeof(size_t));
+  file.write(reinterpret_cast<const char*>(gblCols.data()), numEntries * sizeof(GlobalOrdinal));
+  file.write(reinterpret_cast<const char*>(lclMatrix.values.data()), numEntries * sizeof(Scalar));
+}
+
+/* Write the local part of a vector to a per-rank binary file.
+ *
+ * Layout: number of local entries, global indices, values.
+ */
+void writeVectorBinary(const std::string& prefix, const Tpetra::Vector<Scalar,LocalOrdinal,GlobalOrdinal,Node>& v)
+{
+  const auto map = v.getMap();
+  const size_t numEntries = v.getLocalLength();
+
+  std::vector<GlobalOrdinal> gblIndices(numEntries);
+  for (size_t lclIndex = 0; lclIndex < numEntries; ++lclIndex)
+    gblIndices[lclIndex] = map->getGlobalElement(lclIndex);
+
+  auto values = v.getLocalViewHost(Tpetra::Access::ReadOnly);
+
+  std::ofstream file(getRankFileName(prefix, *map->getComm()), std::ios::binary);
+  file.write(reinterpret_cast<const char*>(&numEntries), sizeof(size_t));
+  file.write(reinterpret_cast<const char*>(gblIndices.data()), numEntries * sizeof(GlobalOrdinal));
+  file.write(reinterpret_cast<const char*>(values.data()), numEntries * sizeof(Scalar));
+}
+
+/* Write the statistics of all timers registered with Teuchos::TimeMonitor to a YAML file.
+ *
+ * All ranks take part in computing the minimum, mean and maximum over all ranks,
+ * only rank 0 writes the file.
+ */
+void writeTimingReport(const std::string& fileName, RCP<const Teuchos::Comm<int>> comm)
+{
+  std::ostringstream report;
+  Teuchos::TimeMonitor::summarizeToYaml(comm.ptr(), report, Teuchos::YAML_FORMAT_SPACIOUS);
+  if (comm->getRank() == 0) {
+    std::ofstream file(fileName);
+    file << report.str();
+  }
+}
+
+#endif
@@ -0,0 +1,179 @@
+#ifndef _CHECKPOINT_
+#define _CHECKPOINT_
+
+#include "utils.hpp"
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <Kokkos_Core.hpp>
+
+#include <Teuchos_Comm.hpp>
+#include <Teuchos_CommHelpers.hpp>
+#include <Teuchos_OrdinalTraits.hpp>
+#include <Teuchos_RCP.hpp>
+#include <Teuchos_TestForException.hpp>
+
+#include <Tpetra_CrsMatrix.hpp>
+#include <Tpetra_Map.hpp>
+#include <Tpetra_MultiVector.hpp>
+
+/* Checkpoint/restart of the assembled linear system and the current iterate.
+ *
+ * Every rank writes its local data to its own binary file <prefix>.<rank>.chk:
+ * the global indices of the row and column map, the local CRS arrays of the fill
+ * complete matrix (offsets, local column indices, values) and the values of x, b
+ * and xExact. Since the local arrays are stored as they are, the matrix is restored
+ * with the same row and column map without building it with Galeri and without
+ * calling fillComplete(). A checkpoint can only be loaded on the same number of ranks.
+ */
+
+std::string getCheckpointFileName(const std::string& prefix, const Teuchos::Comm<int>& comm)
+{
+  return prefix + "." + std::to_string(comm.getRank()) + ".chk";
+}
+
+// Write the values of a multivector column by column
+void writeMultiVectorValues(std::ofstream& file, const Tpetra::MultiVector<Scalar,LocalOrdinal,GlobalOrdinal,Node>& v)
+{
+  for (size_t j = 0; j < v.getNumVectors(); ++j) {
+    Teuchos::ArrayRCP<const Scalar> values = v.getData(j);
+    file.write(reinterpret_cast<const char*>(values.getRawPtr()), v.getLocalLength() * sizeof(Scalar));
+  }
+}
+
+// Read the values of a multivector column by column
+void readMultiVectorValues(std::ifstream& file, Tpetra::MultiVector<Scalar,LocalOrdinal,GlobalOrdinal,Node>& v)
+{
+  for (size_t j = 0; j < v.getNumVectors(); ++j) {
+    Teuchos::ArrayRCP<Scalar> values = v.getDataNonConst(j);
+    file.read(reinterpret_cast<char*>(values.getRawPtr()), v.getLocalLength() * sizeof(Scalar));
+  }
+}
+
+/* Write matrix, current iterate x, right-hand side b and exact solution xExact.
+ *
+ * rebuildTime is the time it took to create the linear system in this run; it is
+ * stored to compare it against the load time when restarting.
+ */
+void writeCheckpoint(const std::string& prefix, const Tpetra::CrsMatrix<Scalar,LocalOrdinal,GlobalOrdinal,Node>& A,
+    const Tpetra::MultiVector<Scalar,LocalOrdinal,GlobalOrdinal,Node>& x,
+    const Tpetra::MultiVector<Scalar,LocalOrdinal,GlobalOrdinal,Node>& b,
+    const Tpetra::MultiVector<Scalar,LocalOrdinal,GlobalOrdinal,Node>& xExact,
+    const double rebuildTime)
+{
+  using offset_type = typename Tpetra::CrsMatrix<Scalar,LocalOrdinal,GlobalOrdinal,Node>::local_matrix_host_type::size_type;
+
+  const auto rowMap = A.getRowMap();
+  const auto colMap = A.getColMap();
+  const auto lclMatrix = A.getLocalMatrixHost();
+
+  const int numRanks = rowMap->getComm()->getSize();
+  const size_t numRows = lclMatrix.numRows();
+  const size_t numCols = colMap->getLocalNumElements();
+  const size_t numEntries = lclMatrix.nnz();
+  const size_t numVectors = x.getNumVectors();
+
+  std::ofstream file(getCheckpointFileName(prefix, *rowMap->getComm()), std::ios::binary);
+  file.write(reinterpret_cast<const char*>(&numRanks), sizeof(int));
+  file.write(reinterpret_cast<const char*>(&rebuildTime), sizeof(double));
+  file.write(reinterpret_cast<const char*>(&numRows), sizeof(size_t));
+  file.write(reinterpret_cast<const char*>(&numCols), sizeof(size_t));
+  file.write(reinterpret_cast<const char*>(&numEntries), sizeof(size_t));
+  file.write(reinterpret_cast<const char*>(&numVectors), sizeof(size_t));
+
+  Teuchos::ArrayView<const GlobalOrdinal> gblRows = rowMap->getLocalElementList();
+  Teuchos::ArrayView<const GlobalOrdinal> gblCols = colMap->getLocalElementList();
+  file.write(reinterpret_cast<const char*>(gblRows.getRawPtr()), numRows * sizeof(GlobalOrdinal));
+  file.write(reinterpret_cast<const char*>(gblCols.getRawPtr()), numCols * sizeof(GlobalOrdinal));
+
+  file.write(reinterpret_cast<const char*>(lclMatrix.graph.row_map.data()), (numRows + 1) * sizeof(offset_type));
+  file.write(reinterpret_cast<const char*>(lclMatrix.graph.entries.data()), numEntries * sizeof(LocalOrdinal));
+  file.write(reinterpret_cast<const char*>(lclMatrix.values.data()), numEntries * sizeof(Scalar));
+
+  writeMultiVectorValues(file, x);
+  writeMultiVectorValues(file, b);
+  writeMultiVectorValues(file, xExact);
+}
+
+/* Restore matrix, iterate x, right-hand side b and exact solution xExact from a checkpoint.
+ *
+ * Returns the rebuild time stored in the checkpoint.
+ */
+double readCheckpoint(const std::string& prefix, RCP<const Teuchos::Comm<int>> comm,
+    RCP<const Tpetra::CrsMatrix<Scalar,LocalOrdinal,GlobalOrdinal,Node>>& A,
+    RCP<Tpetra::MultiVector<Scalar,LocalOrdinal,GlobalOrdinal,Node>>& x,
+    RCP<Tpetra::MultiVector<Scalar,LocalOrdinal,GlobalOrdinal,Node>>& b,
+    RCP<Tpetra::MultiVector<Scalar,LocalOrdinal,GlobalOrdinal,Node>>& xExact)
+{
+  using crs_matrix_type = Tpetra::CrsMatrix<Scalar,LocalOrdinal,GlobalOrdinal,Node>;
+  using map_type = Tpetra::Map<LocalOrdinal,GlobalOrdinal,Node>;
+  using multivec_type = Tpetra::MultiVector<Scalar,LocalOrdinal,GlobalOrdinal,Node>;
+  using local_matrix_type = typename crs_matrix_type::local_matrix_device_type;
+  using row_offsets_type = typename local_matrix_type::row_map_type::non_const_type;
+  using col_indices_type = typename local_matrix_type::index_type::non_const_type;
+  using values_type = typename local_matrix_type::values_type::non_const_type;
+  using offset_type = typename local_matrix_type::size_type;
+
+  const std::string fileName = getCheckpointFileName(prefix, *comm);
+  std::ifstream file(fileName, std::ios::binary);
+  int numRanks = 0;
+  if (file) file.read(reinterpret_cast<char*>(&numRanks), sizeof(int));
+
+  // All ranks have to agree before throwing: a missing file or a checkpoint of a
+  // different number of ranks may only be detected on some ranks
+  int lclError = !file ? 1 : (numRanks != comm->getSize() ? 2 : 0), gblError = 0;
+  Teuchos::reduceAll(*comm, Teuchos::REDUCE_MAX, lclError, Teuchos::outArg(gblError));
+  TEUCHOS_TEST_FOR_EXCEPTION(gblError == 1, std::runtime_error, "Cannot open checkpoint files " << prefix << ".<rank>.chk on all ranks.");
+  TEUCHOS_TEST_FOR_EXCEPTION(gblError == 2, std::runtime_error,
+      "Checkpoint " << prefix << " was not written on the " << comm->getSize() << " ranks of this run.");
+
+  double rebuildTime = 0.0;
+  size_t numRows = 0, numCols = 0, numEntries = 0, numVectors = 0;
+  file.read(reinterpret_cast<char*>(&rebuildTime), sizeof(double));
+  file.read(reinterpret_cast<char*>(&numRows), sizeof(size_t));
+  file.read(reinterpret_cast<char*>(&numCols), sizeof(size_t));
+  file.read(reinterpret_cast<char*>(&numEntries), sizeof(size_t));
+  file.read(reinterpret_cast<char*>(&numVectors), sizeof(size_t));
+
+  // Row and column map with the stored order of the global indices
+  std::vector<GlobalOrdinal> gblRows(numRows), gblCols(numCols);
+  file.read(reinterpret_cast<char*>(gblRows.data()), numRows * sizeof(GlobalOrdinal));
+  file.read(reinterpret_cast<char*>(gblCols.data()), numCols * sizeof(GlobalOrdinal));
+  const Tpetra::global_size_t invalid = Teuchos::OrdinalTraits<Tpetra::global_size_t>::invalid();
+  RCP<const map_type> rowMap = rcp(new map_type(invalid, Teuchos::ArrayView<const GlobalOrdinal>(gblRows), 0, comm));
+  RCP<const map_type> colMap = rcp(new map_type(invalid, Teuchos::ArrayView<const GlobalOrdinal>(gblCols), 0, comm));
+
+  // Local CRS arrays, read on the host and copied to the device
+  row_offsets_type rowOffsets(Kokkos::view_alloc(Kokkos::WithoutInitializing, "row offsets"), numRows + 1);
+  col_indices_type colIndices(Kokkos::view_alloc(Kokkos::WithoutInitializing, "column indices"), numEntries);
+  values_type values(Kokkos::view_alloc(Kokkos::WithoutInitializing, "values"), numEntries);
+  auto hostRowOffsets = Kokkos::create_mirror_view(rowOffsets);
+  auto hostColIndices = Kokkos::create_mirror_view(colIndices);
+  auto hostValues = Kokkos::create_mirror_view(values);
+  file.read(reinterpret_cast<char*>(hostRowOffsets.data()), (numRows + 1) * sizeof(offset_type));
+  file.read(reinterpret_cast<char*>(hostColIndices.data()), numEntries * sizeof(LocalOrdinal));
+  file.read(reinterpret_cast<char*>(hostValues.data()), numEntries * sizeof(Scalar));
+  Kokkos::deep_copy(rowOffsets, hostRowOffsets);
+  Kokkos::deep_copy(colIndices, hostColIndices);
+  Kokkos::deep_copy(values, hostValues);
+
+  // The matrix is fill complete right away; domain and range map equal the row map
+  local_matrix_type lclMatrix("A", numRows, numCols, numEntries, values, rowOffsets, colIndices);
+  A = rcp(new crs_matrix_type(lclMatrix, rowMap, colMap, rowMap, rowMap));
+
+  x = rcp(new multivec_type(rowMap, numVectors, false));
+  b = rcp(new multivec_type(rowMap, numVectors, false));
+  xExact = rcp(new multivec_type(rowMap, numVectors, false));
+  readMultiVectorValues(file, *x);
+  readMultiVectorValues(file, *b);
+  readMultiVectorValues(file, *xExact);
+  lclError = !file ? 1 : 0;
+  Teuchos::reduceAll(*comm, Teuchos::REDUCE_MAX, lclError, Teuchos::outArg(gblError));
+  TEUCHOS_TEST_FOR_EXCEPTION(gblError != 0, std::runtime_error, "Checkpoint files " << prefix << ".<rank>.chk are truncated.");
+
+  return rebuildTime;
+}
+
+#endif
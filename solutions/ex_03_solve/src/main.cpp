@@ -2,24 +2,48 @@
  * with the help of the packages Belos and Ifpack2.
  */
 
+#include "checkpoint.hpp"
+#include "matrix_free_operator.hpp"
+#include "matrix_market_reader.hpp"
+#include "overlapping_operator.hpp"
+#include "profiling_operator.hpp"
+#include "reduction_counter.hpp"
 #include "utils.hpp"
 
+#include <algorithm>
 #include <cstdlib>
 
 #include <BelosBlockCGSolMgr.hpp>
 #include <BelosConfigDefs.hpp>
 #include <BelosLinearProblem.hpp>
+#include <BelosSolverFactory_Tpetra.hpp>
 #include <BelosTpetraAdapter.hpp>
 #include <BelosTypes.hpp>
 
 #include <Ifpack2_Factory.hpp>
 #include <Ifpack2_Preconditioner.hpp>
 
+#include <Kokkos_Core.hpp>
+
+#include <MatrixMarket_Tpetra.hpp>
+
+#include <MueLu_CreateTpetraPreconditioner.hpp>
+#include <MueLu_TpetraOperator.hpp>
+
+#include <Teuchos_Array.hpp>
+#include <Teuchos_CommHelpers.hpp>
 #include <Teuchos_ParameterList.hpp>
 #include <Teuchos_RCP.hpp>
+#include <Teuchos_Time.hpp>
+#include <Teuchos_TimeMonitor.hpp>
+#include <Teuchos_XMLParameterListHelpers.hpp>
 
 #include <Tpetra_Core.hpp>
+#include <Tpetra_BlockCrsMatrix.hpp>
+#include <Tpetra_BlockCrsMatrix_Helpers.hpp>
 #include <Tpetra_CrsMatrix.hpp>
+#include <Tpetra_Import.hpp>
+#include <Tpetra_Map.hpp>
 #include <Tpetra_MultiVector.hpp>
 #include <Tpetra_Operator.hpp>
 #include <Tpetra_Vector.hpp>
@@ -35,30 +59,79 @@ int main(int argc, char *argv[]) {
   using global_ordinal_type = Tpetra::MultiVector<>::global_ordinal_type;
   using node_type = Tpetra::MultiVector<>::node_type;
 
+  using block_crs_matrix_type = Tpetra::BlockCrsMatrix<scalar_type, local_ordinal_type, global_ordinal_type, node_type>;
   using crs_matrix_type = Tpetra::CrsMatrix<scalar_type, local_ordinal_type, global_ordinal_type, node_type>;
   using multivec_type = Tpetra::MultiVector<scalar_type, local_ordinal_type, global_ordinal_type, node_type>;
   using operator_type = Tpetra::Operator<scalar_type, local_ordinal_type, global_ordinal_type, node_type>;
   using row_matrix_type = Tpetra::RowMatrix<>;
   using vec_type = Tpetra::Vector<scalar_type, local_ordinal_type, global_ordinal_type, node_type>;
+  using coord_multivec_type = Tpetra::MultiVector<Teuchos::ScalarTraits<scalar_type>::coordinateType, local_ordinal_type, global_ordinal_type, node_type>;
 
   using prec_type = Ifpack2::Preconditioner<>;
   using problem_type = Belos::LinearProblem<scalar_type, multivec_type, operator_type>;
   using solver_type = Belos::SolverManager<scalar_type, multivec_type, operator_type>;
 
+  // Single precision types for the inner solve of mixed-precision iterative refinement
+  using float_crs_matrix_type = Tpetra::CrsMatrix<float, local_ordinal_type, global_ordinal_type, node_type>;
+  using float_multivec_type = Tpetra::MultiVector<float, local_ordinal_type, global_ordinal_type, node_type>;
+  using float_operator_type = Tpetra::Operator<float, local_ordinal_type, global_ordinal_type, node_type>;
+  using float_row_matrix_type = Tpetra::RowMatrix<float, local_ordinal_type, global_ordinal_type, node_type>;
+  using float_prec_type = Ifpack2::Preconditioner<float, local_ordinal_type, global_ordinal_type, node_type>;
+  using float_problem_type = Belos::LinearProblem<float, float_multivec_type, float_operator_type>;
+  using float_solver_type = Belos::SolverManager<float, float_multivec_type, float_operator_type>;
+
+  // Initialize MPI and Kokkos first: Kokkos removes its own arguments (such as
+  // --kokkos-num-threads) from the command line before we parse the rest.
+  // Never create Tpetra objects at main() scope.
+  // Never allow them to persist past ScopeGuard's destructor.
+  Tpetra::ScopeGuard tpetraScope(&argc, &argv);
+
   // Read input parameters from command line
   Teuchos::CommandLineProcessor clp;
   std::string matrixType = "Laplace2D"; clp.setOption("matrixType", &matrixType, "Type of problem to be solved [Laplace1D, Laplace2D, Laplace3D, Elasticity2D, Elasticity3D] (default: Laplace2D)");
   global_ordinal_type nx = 10; clp.setOption("nx", &nx, "Number of mesh nodes in x-direction");
   global_ordinal_type ny = 10; clp.setOption("ny", &ny, "Number of mesh nodes in y-direction");
   global_ordinal_type nz = 10; clp.setOption("nz", &nz, "Number of mesh nodes in z-direction");
+  global_ordinal_type mx = -1; clp.setOption("mx", &mx, "Number of ranks in x-direction of the process grid; -1 chooses mx, my, and mz with minimal halo volume (default: -1)");
+  global_ordinal_type my = -1; clp.setOption("my", &my, "Number of ranks in y-direction of the process grid (default: -1)");
+  global_ordinal_type mz = -1; clp.setOption("mz", &mz, "Number of ranks in z-direction of the process grid (default: -1)");
+  std::string repartition = "none"; clp.setOption("repartition", &repartition, "Repartition the matrix with Zoltan2 [none, graph, geometric] (default: none)");
+  std::string matrixFile = ""; clp.setOption("matrixFile", &matrixFile, "MatrixMarket file with the system matrix to be solved instead of a Galeri problem (default: none)");
+  std::string matrixReader = "parallel"; clp.setOption("matrixReader", &matrixReader, "Reader of the matrix file [parallel, stock, both]; both compares the parallel reader to Tpetra::MatrixMarket::Reader (default: parallel)");
+  std::string reordering = "none"; clp.setOption("reordering", &reordering, "Symmetric reordering of the rank-local block before the preconditioner setup [none, rcm, amd, metis] (default: none)");
+  std::string systemGenerator = "apply"; clp.setOption("systemGenerator", &systemGenerator, "Creation of exact solution and right-hand side [apply, fused]; fused computes both in one kernel without SpMV (default: apply)");
+  std::string saveCheckpoint = ""; clp.setOption("saveCheckpoint", &saveCheckpoint, "Prefix of the per-rank checkpoint files written after the solve with matrix, x, b and the exact solution (default: none)");
+  std::string loadCheckpoint = ""; clp.setOption("loadCheckpoint", &loadCheckpoint, "Prefix of the per-rank checkpoint files to restart from instead of building the linear system; the solve continues from the stored x (default: none)");
+  bool useMatrixFree = false; clp.setOption("matrixFree", "assembled", &useMatrixFree, "Apply the Laplace2D/Laplace3D stencil matrix-free in the Krylov solver (default: assembled)");
+  bool overlapHalo = false; clp.setOption("overlapHalo", "noOverlapHalo", &overlapHalo, "Overlap the halo exchange with the SpMV of the interior rows in the Krylov solver (default: off)");
+  int numApplies = 100; clp.setOption("numApplies", &numApplies, "Number of operator applications to measure the SpMV throughput in matrix-free and block CRS mode and the preconditioner apply with reordering (default: 100)");
 
   scalar_type tol = 1.0e-4; clp.setOption("tol", &tol, "Tolerance to check for convergence of Krylov solver");
   int maxIters = 100; clp.setOption("maxIters", &maxIters, "Maximum number of iterations of the Krylov solver");
+  int numBlocks = 300; clp.setOption("numBlocks", &numBlocks, "Restart length of GMRES, i.e. maximum number of Krylov basis vectors (default: 300)");
+  int numRHS = 1; clp.setOption("numRHS", &numRHS, "Number of right-hand sides solved as one block (default: 1)");
+  bool mixedPrecision = false; clp.setOption("mixedPrecision", "noMixedPrecision", &mixedPrecision, "Also solve by iterative refinement in double with an inner Belos solve and Ifpack2 preconditioner in float (default: off)");
+  double innerTol = 1.0e-3; clp.setOption("innerTol", &innerTol, "Relative tolerance of the inner single precision solve in mixed-precision mode (default: 1e-3)");
+  int maxRefinements = 20; clp.setOption("maxRefinements", &maxRefinements, "Maximum number of refinement steps in mixed-precision mode (default: 20)");
+  bool useBlockCrs = false; clp.setOption("blockCrs", "noBlockCrs", &useBlockCrs, "Also solve with the matrix in block CRS format with one block per mesh node (Elasticity2D/3D) (default: off)");
+  int numSteps = 0; clp.setOption("numSteps", &numSteps, "Number of time steps re-solving with updated matrix values, reusing preconditioner and solver (default: 0)");
+  std::string solverType = "GMRES"; clp.setOption("solverType", &solverType, "Type of Belos solver [GMRES, Block GMRES, Pseudo Block GMRES, Block CG, Pseudo Block CG, Pipelined CG, Single Reduce CG, Pipelined GMRES, Single Reduce GMRES, s-step GMRES] (default: GMRES)");
+  std::string orthoType = "DGKS"; clp.setOption("orthoType", &orthoType, "Orthogonalization of GMRES, Block GMRES and Pseudo Block GMRES [DGKS, ICGS, IMGS, TSQR] (default: DGKS)");
+  int stepSize = 5; clp.setOption("stepSize", &stepSize, "Number of basis vectors computed per global reduction in s-step GMRES (default: 5)");
   bool usePreconditioner = false; clp.setOption("withPreconditioner", "noPreconditioner", &usePreconditioner, "Flag to activate/deactivate the preconditioner.");
 
-  std::string relaxationType = "Jacobi"; clp.setOption("precType", &relaxationType, "Type of preconditioner [Jacobi, Gauss-Seidel, Symmetric Gauss-Seidel] (default: Jacobi)");
+  std::string precType = "Jacobi"; clp.setOption("precType", &precType, "Type of preconditioner [Jacobi, Gauss-Seidel, Symmetric Gauss-Seidel, Chebyshev, RILUK, ILUT, Schwarz, MueLu] (default: Jacobi)");
   int numSweeps = 1; clp.setOption("numSweeps", &numSweeps, "Number of relaxation sweeps in the preconditioner (default: 1)");
   double damping = 2./3.; clp.setOption("damping", &damping, "Damping parameter for relaxation preconditioner (default: 2/3)");
+  int polyDegree = 2; clp.setOption("polyDegree", &polyDegree, "Degree of the Chebyshev polynomial (default: 2)");
+  int eigIters = 10; clp.setOption("eigIters", &eigIters, "Number of power iterations to estimate the largest eigenvalue for Chebyshev (default: 10)");
+  double eigRatio = 30.0; clp.setOption("eigRatio", &eigRatio, "Ratio of largest to smallest eigenvalue targeted by Chebyshev (default: 30)");
+  double levelOfFill = 1.0; clp.setOption("levelOfFill", &levelOfFill, "Level of fill for RILUK (rounded down) and ILUT (default: 1)");
+  double dropTol = 0.0; clp.setOption("dropTol", &dropTol, "Drop tolerance for ILUT (default: 0)");
+  int overlap = 1; clp.setOption("overlap", &overlap, "Overlap level of additive Schwarz (default: 1)");
+  std::string subdomainSolver = "RILUK"; clp.setOption("subdomainSolver", &subdomainSolver, "Subdomain solver of additive Schwarz [RILUK, ILUT, KLU] (default: RILUK)");
+  std::string mueluXml = ""; clp.setOption("mueluXml", &mueluXml, "XML file with MueLu parameters overriding the smoothed aggregation defaults (default: none)");
+  std::string timingReport = ""; clp.setOption("timingReport", &timingReport, "YAML file for the timings of all phases (min/mean/max over all ranks) (default: none)");
 
   switch (clp.parse(argc, argv)) {
     case Teuchos::CommandLineProcessor::PARSE_HELP_PRINTED:        return EXIT_SUCCESS;
@@ -67,9 +140,6 @@ int main(int argc, char *argv[]) {
     case Teuchos::CommandLineProcessor::PARSE_SUCCESSFUL:          break;
   }
 
-  // Never create Tpetra objects at main() scope.
-  // Never allow them to persist past ScopeGuard's destructor.
-  Tpetra::ScopeGuard tpetraScope(&argc, &argv);
   {
     // Create MPI communicator via Tpetra and obtain local MPI rank and the
     // total size of the MPI communicator
@@ -81,25 +151,272 @@ int main(int argc, char *argv[]) {
     RCP<Teuchos::FancyOStream> out = Teuchos::fancyOStream(Teuchos::rcpFromRef(std::cout));
     out->setOutputToRootOnly(0);
 
+    *out << "Number of ranks: " << numProcs << ", Kokkos execution space: " << Kokkos::DefaultExecutionSpace::name()
+        << " (concurrency: " << Kokkos::DefaultExecutionSpace().concurrency() << ")" << std::endl;
+
     ////////////////////////////////////////////////////////////////////////////
     ////////////////////////////////////////////////////////////////////////////
-    *out << ">> I. Create linear system A*x=b for a " << matrixType << " problem." << std::endl;
+    if (matrixFile.empty())
+      *out << ">> I. Create linear system A*x=b for a " << matrixType << " problem." << std::endl;
+    else
+      *out << ">> I. Create linear system A*x=b for the matrix in " << matrixFile << "." << std::endl;
 
     ParameterList galeriList;
     galeriList.set("nx", nx);
     galeriList.set("ny", ny);
     galeriList.set("nz", nz);
     galeriList.set("matrixType", matrixType);
+
+    // Distribute the grid on a process grid of mx * my * mz ranks. It is chosen
+    // automatically if none of the dimensions of the problem's grid is given.
+    const std::string gridType = getGridType(matrixType);
+    const bool is2DGrid = (gridType == "Cartesian2D"), is3DGrid = (gridType == "Cartesian3D");
+    if (mx < 1 && (!(is2DGrid || is3DGrid) || my < 1) && (!is3DGrid || mz < 1)) {
+      computeProcessGrid(gridType, numProcs, nx, ny, nz, mx, my, mz);
+    } else {
+      if (!is2DGrid && !is3DGrid) my = 1;
+      if (!is3DGrid) mz = 1;
+      if (mx < 1 || my < 1 || mz < 1 || mx * my * mz != numProcs) {
+        *out << "The process grid " << mx << " x " << my << " x " << mz << " does not match the " << numProcs
+            << " ranks; give all of mx" << (is2DGrid || is3DGrid ? ", my" : "") << (is3DGrid ? ", mz" : "")
+            << " with a product of " << numProcs << " or none of them." << std::endl;
+        return EXIT_FAILURE;
+      }
+    }
+    galeriList.set("mx", mx);
+    galeriList.set("my", my);
+    galeriList.set("mz", mz);
+    *out << "Process grid: " << mx << " x " << my << " x " << mz << std::endl;
+
+    if (systemGenerator != "apply" && systemGenerator != "fused") {
+      *out << "Unknown system generator '" << systemGenerator << "'." << std::endl;
+      return EXIT_FAILURE;
+    }
+    // Only createLinearSystem() generates xExact and b on the Galeri distribution;
+    // checkpoints store them, matrix files and repartitioning randomize them.
+    if (systemGenerator == "fused" && (!loadCheckpoint.empty() || !matrixFile.empty() || repartition != "none")) {
+      *out << "The fused system generator cannot be combined with a checkpoint, a matrix file or repartitioning." << std::endl;
+      return EXIT_FAILURE;
+    }
+
     RCP<const crs_matrix_type> matrix = Teuchos::null;
-    RCP<vec_type> x = Teuchos::null;
-    RCP<vec_type> rhs = Teuchos::null;
-    createLinearSystem(galeriList, comm, matrix, x, rhs);
+    RCP<multivec_type> x = Teuchos::null;
+    RCP<multivec_type> rhs = Teuchos::null;
+    RCP<multivec_type> xExact = Teuchos::null;
+    double systemSetupTime = 0.0; // creation and repartitioning, stored in a checkpoint
+    if (!loadCheckpoint.empty()) {
+      // Restart: matrix and vectors are restored as they were written, i.e. on the
+      // distribution of the run that wrote the checkpoint.
+      if (useMatrixFree || repartition != "none") {
+        *out << "Restarting from a checkpoint cannot be combined with matrix-free mode or repartitioning." << std::endl;
+        return EXIT_FAILURE;
+      }
+      Teuchos::Time loadTimer("Load checkpoint");
+      comm->barrier();
+      loadTimer.start(true);
+      systemSetupTime = readCheckpoint(loadCheckpoint, comm, matrix, x, rhs, xExact);
+      loadTimer.stop();
+      if (static_cast<int>(x->getNumVectors()) != numRHS) {
+        *out << "Checkpoint '" << loadCheckpoint << "' holds " << x->getNumVectors() << " right-hand sides, but numRHS = "
+            << numRHS << "." << std::endl;
+        return EXIT_FAILURE;
+      }
+      *out << "Checkpoint load: " << getMaxTime(loadTimer, *comm) << " s (linear system creation in the run that wrote it: "
+          << systemSetupTime << " s)" << std::endl;
+    } else if (!matrixFile.empty()) {
+      // A matrix from a file has no mesh: Galeri-specific features are not available.
+      if (useMatrixFree || repartition == "geometric" || useBlockCrs) {
+        *out << "A matrix file cannot be combined with matrix-free mode, geometric repartitioning or block CRS mode." << std::endl;
+        return EXIT_FAILURE;
+      }
+      if (matrixReader != "parallel" && matrixReader != "stock" && matrixReader != "both") {
+        *out << "Unknown matrix reader '" << matrixReader << "'." << std::endl;
+        return EXIT_FAILURE;
+      }
+      Teuchos::Time readTimer("Read matrix file");
+      if (matrixReader != "stock") {
+        comm->barrier();
+        readTimer.start(true);
+        matrix = readMatrixMarketParallel(matrixFile, comm);
+        readTimer.stop();
+        systemSetupTime = getMaxTime(readTimer, *comm);
+        *out << "Parallel MatrixMarket reader: " << systemSetupTime << " s" << std::endl;
+      }
+      if (matrixReader != "parallel") {
+        Teuchos::Time stockReadTimer("Read matrix file (stock)");
+        comm->barrier();
+        stockReadTimer.start(true);
+        RCP<const crs_matrix_type> stockMatrix = Tpetra::MatrixMarket::Reader<crs_matrix_type>::readSparseFile(matrixFile, comm);
+        stockReadTimer.stop();
+        *out << "Tpetra::MatrixMarket::Reader: " << getMaxTime(stockReadTimer, *comm) << " s" << std::endl;
+
+        if (matrix.is_null()) {
+          matrix = stockMatrix;
+          systemSetupTime = getMaxTime(stockReadTimer, *comm);
+        } else {
+          // Both readers distribute the rows uniformly, so the matrices can be compared by applying them
+          multivec_type xTest(matrix->getDomainMap(), 1);
+          multivec_type yParallel(matrix->getRangeMap(), 1);
+          multivec_type yStock(stockMatrix->getRangeMap(), 1);
+          xTest.randomize();
+          matrix->apply(xTest, yParallel);
+          stockMatrix->apply(xTest, yStock);
+          Teuchos::Array<Teuchos::ScalarTraits<scalar_type>::magnitudeType> norms(1), diffNorms(1);
+          yStock.norm2(norms());
+          yParallel.update(-1.0, yStock, 1.0);
+          yParallel.norm2(diffNorms());
+          *out << "Relative difference of parallel and stock reader: " << diffNorms[0] / norms[0] << " (speedup: "
+              << getMaxTime(stockReadTimer, *comm) / systemSetupTime << ")" << std::endl;
+        }
+      }
+      *out << "Matrix: " << matrix->getGlobalNumRows() << " rows, " << matrix->getGlobalNumEntries() << " entries" << std::endl;
+
+      // Random exact solution, zero initial guess
+      x = rcp(new multivec_type(matrix->getDomainMap(), numRHS));
+      xExact = rcp(new multivec_type(matrix->getDomainMap(), numRHS, false));
+      rhs = rcp(new multivec_type(matrix->getRangeMap(), numRHS, false));
+      xExact->randomize();
+      matrix->apply(*xExact, *rhs);
+    } else {
+      Teuchos::Time createTimer("Create linear system");
+      comm->barrier();
+      createTimer.start(true);
+      createLinearSystem(galeriList, comm, matrix, x, rhs, xExact, numRHS, systemGenerator);
+      createTimer.stop();
+      systemSetupTime = getMaxTime(createTimer, *comm);
+      *out << "Linear system creation: " << systemSetupTime << " s, thereof generation of xExact and b ("
+          << systemGenerator << "): " << getMaxTime(*Teuchos::TimeMonitor::lookupCounter("ex_03: System generation"), *comm)
+          << " s" << std::endl;
+    }
+
+    double minHalo = 0.0, meanHalo = 0.0, maxHalo = 0.0;
+    getHaloVolume(*matrix, *comm, minHalo, meanHalo, maxHalo);
+    *out << "Halo volume per rank (min / mean / max): " << minHalo << " / " << meanHalo << " / " << maxHalo << std::endl;
+
+    // Optionally, repartition the matrix with Zoltan2 and create the vectors on the new distribution
+    if (repartition == "graph" || repartition == "geometric") {
+      if (useMatrixFree) {
+        *out << "Matrix-free mode requires the Galeri distribution and cannot be combined with repartitioning." << std::endl;
+        return EXIT_FAILURE;
+      }
+      RCP<multivec_type> nullspace = Teuchos::null;
+      RCP<coord_multivec_type> coordinates = Teuchos::null;
+      if (matrixFile.empty())
+        buildNullspaceAndCoordinates(galeriList, comm, nullspace, coordinates);
+
+      Teuchos::Time& repartitionTimer = *Teuchos::TimeMonitor::getNewCounter("ex_03: Repartitioning");
+      comm->barrier();
+      repartitionTimer.start(true);
+      matrix = repartitionMatrix(matrix, coordinates, repartition, matrixFile.empty() ? getNumDofsPerNode(matrixType) : 1);
+      repartitionTimer.stop();
+
+      x = rcp(new multivec_type(matrix->getDomainMap(), numRHS));
+      xExact = rcp(new multivec_type(matrix->getDomainMap(), numRHS, false));
+      rhs = rcp(new multivec_type(matrix->getRangeMap(), numRHS, false));
+      xExact->randomize();
+      matrix->apply(*xExact, *rhs);
+
+      getHaloVolume(*matrix, *comm, minHalo, meanHalo, maxHalo);
+      systemSetupTime += getMaxTime(repartitionTimer, *comm);
+      *out << "Repartitioning with Zoltan2 (" << repartition << "): " << getMaxTime(repartitionTimer, *comm) << " s" << std::endl;
+      *out << "Halo volume per rank after repartitioning (min / mean / max): " << minHalo << " / " << meanHalo
+          << " / " << maxHalo << std::endl;
+    } else if (repartition != "none") {
+      *out << "Unknown repartitioning method '" << repartition << "'." << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    // Optionally, reorder the rank-local blocks of the matrix and move the vectors along.
+    // The original matrix is kept to compare the preconditioner with and without reordering.
+    RCP<const crs_matrix_type> naturalMatrix = matrix;
+    if (reordering == "rcm" || reordering == "amd" || reordering == "metis") {
+      if (useMatrixFree || useBlockCrs) {
+        *out << "Reordering cannot be combined with matrix-free mode or block CRS mode." << std::endl;
+        return EXIT_FAILURE;
+      }
+      Teuchos::Time& reorderTimer = *Teuchos::TimeMonitor::getNewCounter("ex_03: Reordering");
+      comm->barrier();
+      reorderTimer.start(true);
+      matrix = reorderMatrix(naturalMatrix, reordering);
+      reorderTimer.stop();
+
+      Tpetra::Import<local_ordinal_type, global_ordinal_type, node_type> importer(naturalMatrix->getRowMap(), matrix->getRowMap());
+      for (RCP<multivec_type>* v : {&x, &rhs, &xExact}) {
+        RCP<multivec_type> reordered = rcp(new multivec_type(matrix->getRowMap(), numRHS, false));
+        reordered->doImport(**v, importer, Tpetra::INSERT);
+        *v = reordered;
+      }
+      *out << "Reordering of the rank-local blocks (" << reordering << "): " << getMaxTime(reorderTimer, *comm) << " s" << std::endl;
+    } else if (reordering != "none") {
+      *out << "Unknown reordering method '" << reordering << "'." << std::endl;
+      return EXIT_FAILURE;
+    }
+
+    // Optionally, apply the system matrix matrix-free. The assembled matrix is still
+    // used by the preconditioners and serves as reference.
+    RCP<const operator_type> systemOperator = matrix;
+    if (useMatrixFree) {
+      if (matrixType != "Laplace2D" && matrixType != "Laplace3D") {
+        *out << "Matrix-free mode supports Laplace2D and Laplace3D only." << std::endl;
+        return EXIT_FAILURE;
+      }
+      if (numSteps > 0) {
+        *out << "Matrix-free mode cannot be combined with time stepping, which changes the matrix values." << std::endl;
+        return EXIT_FAILURE;
+      }
+      RCP<const MatrixFreeStencilOperator> matrixFreeOperator = rcp(new MatrixFreeStencilOperator(galeriList, comm));
+      systemOperator = matrixFreeOperator;
+
+      // Compare against the assembled matrix
+      multivec_type xTest(matrix->getDomainMap(), 1);
+      multivec_type yAssembled(matrix->getRangeMap(), 1);
+      multivec_type yMatrixFree(matrix->getRangeMap(), 1);
+      xTest.randomize();
+      matrix->apply(xTest, yAssembled);
+      matrixFreeOperator->apply(xTest, yMatrixFree);
+      Teuchos::Array<Teuchos::ScalarTraits<scalar_type>::magnitudeType> norms(1), diffNorms(1);
+      yAssembled.norm2(norms());
+      yMatrixFree.update(-1.0, yAssembled, 1.0);
+      yMatrixFree.norm2(diffNorms());
+      *out << "Relative difference of matrix-free and assembled operator: " << diffNorms[0] / norms[0] << std::endl;
+
+      // Memory and SpMV throughput. Both variants perform the same number of
+      // floating point operations, i.e. 2 per matrix entry.
+      const double assembledMemory = getCrsMatrixMemory(*matrix, *comm);
+      double matrixFreeMemory = 0.0;
+      Teuchos::reduceAll<int, double>(*comm, Teuchos::REDUCE_SUM, static_cast<double>(matrixFreeOperator->getLocalMemoryBytes()),
+          Teuchos::outArg(matrixFreeMemory));
+      const double flops = 2.0 * matrix->getGlobalNumEntries() * numApplies;
+      const double assembledTime = timeApply(*matrix, xTest, yAssembled, numApplies, *comm);
+      const double matrixFreeTime = timeApply(*matrixFreeOperator, xTest, yMatrixFree, numApplies, *comm);
+      *out << "Assembled:   " << assembledMemory / 1.0e6 << " MB operator data, "
+          << flops / assembledTime / 1.0e9 << " GFLOP/s" << std::endl;
+      *out << "Matrix-free: " << matrixFreeMemory / 1.0e6 << " MB operator data (ghosted vector), "
+          << flops / matrixFreeTime / 1.0e9 << " GFLOP/s" << std::endl;
+    }
+
+    // Optionally, overlap the halo exchange with the interior rows in every operator application
+    RCP<const OverlappingCrsOperator> overlappingOperator = Teuchos::null;
+    if (overlapHalo) {
+      if (useMatrixFree || numSteps > 0) {
+        *out << "Overlapping the halo exchange cannot be combined with matrix-free mode or time stepping." << std::endl;
+        return EXIT_FAILURE;
+      }
+      overlappingOperator = rcp(new OverlappingCrsOperator(matrix));
+      systemOperator = overlappingOperator;
+
+      size_t numBoundaryRows = 0;
+      Teuchos::reduceAll<int, size_t>(*comm, Teuchos::REDUCE_SUM, overlappingOperator->getNumBoundaryRows(),
+          Teuchos::outArg(numBoundaryRows));
+      *out << "Overlapped SpMV: " << numBoundaryRows << " of " << matrix->getGlobalNumRows()
+          << " rows reference halo entries" << std::endl;
+    }
 
     ////////////////////////////////////////////////////////////////////////////
     ////////////////////////////////////////////////////////////////////////////
     *out << ">> II. Create a ";
     if (usePreconditioner) *out << "preconditioned ";
-    *out << "GMRES solver from the Belos package." << std::endl;
+    *out << solverType << " solver from the Belos package." << std::endl;
 
     // Create Belos iterative linear solver
     RCP<solver_type> solver = Teuchos::null;
@@ -110,10 +427,29 @@ int main(int argc, char *argv[]) {
 
       solverParams->set("Maximum Iterations", maxIters);
       solverParams->set("Convergence Tolerance", tol);
+      // Scale residuals by ||b|| instead of the initial residual, such that a solve
+      // restarted from a checkpoint continues with the same stopping criterion. For the
+      // zero initial guess of a fresh start, both are the same.
+      if (solverType == "Pseudo Block CG") {
+        solverParams->set("Residual Scaling", "Norm of RHS");
+      } else if (solverType == "GMRES" || solverType == "Block GMRES" || solverType == "Pseudo Block GMRES" || solverType == "Block CG") {
+        solverParams->set("Implicit Residual Scaling", "Norm of RHS");
+        if (solverType != "Block CG") solverParams->set("Explicit Residual Scaling", "Norm of RHS");
+      }
+      if (solverType.find("GMRES") != std::string::npos)
+        solverParams->set("Num Blocks", numBlocks);
+      if (solverType == "GMRES" || solverType == "Block GMRES" || solverType == "Pseudo Block GMRES")
+        solverParams->set("Orthogonalization", orthoType);
+      if (solverType == "s-step GMRES")
+        solverParams->set("Step Size", stepSize);
+
+      // True block solvers iterate on all right-hand sides at once
+      if (solverType == "Block GMRES" || solverType == "Block CG")
+        solverParams->set("Block Size", numRHS);
 
       /* START OF TODO: Create Belos solver */
       Belos::SolverFactory<scalar_type, multivec_type, operator_type> belosFactory;
-      solver = belosFactory.create ("GMRES", solverParams);
+      solver = belosFactory.create (getBelosSolverName(solverType), solverParams);
       /* END OF TODO: Create Belos solver */
     }
     if (solver.is_null ()) {
@@ -123,12 +459,66 @@ int main(int argc, char *argv[]) {
       return EXIT_FAILURE;
     }
 
-    // Optionally, create Ifpack2 preconditioner.
+    // Optionally, create Ifpack2 preconditioner or MueLu multigrid preconditioner.
     RCP<prec_type> prec = Teuchos::null;
-    if (usePreconditioner)
+    RCP<operator_type> mueluPrec = Teuchos::null;
+    // The timers are registered with Teuchos::TimeMonitor to be included in its summary.
+    // Ifpack2 registers its own timers for initialize(), compute() and apply().
+    Teuchos::Time& precSetupTimer = *Teuchos::TimeMonitor::getNewCounter("ex_03: Preconditioner setup");
+    ParameterList mueluParams;
+    ParameterList ifpack2Params;
+    if (usePreconditioner && precType == "MueLu")
     {
+      // Smoothed aggregation AMG. The nullspace of the Galeri problem (rigid body
+      // modes for elasticity) and the node coordinates are passed as user data.
+      RCP<multivec_type> nullspace = Teuchos::null;
+      RCP<coord_multivec_type> coordinates = Teuchos::null;
+      if (matrixFile.empty())
+        buildNullspaceAndCoordinates(galeriList, comm, nullspace, coordinates);
+      if (!nullspace.is_null() && !nullspace->getMap()->isSameAs(*matrix->getRowMap())) {
+        // The matrix has been redistributed: move the nullspace and the node
+        // coordinates along. All dofs of a node are kept on the same rank.
+        Tpetra::Import<local_ordinal_type, global_ordinal_type, node_type> importer(nullspace->getMap(), matrix->getRowMap());
+        RCP<multivec_type> newNullspace = rcp(new multivec_type(matrix->getRowMap(), nullspace->getNumVectors()));
+        newNullspace->doImport(*nullspace, importer, Tpetra::INSERT);
+        nullspace = newNullspace;
+
+        RCP<const Tpetra::Map<local_ordinal_type, global_ordinal_type, node_type>> nodeMap =
+            getNodeMap(*matrix->getRowMap(), getNumDofsPerNode(matrixType));
+        Tpetra::Import<local_ordinal_type, global_ordinal_type, node_type> nodeImporter(coordinates->getMap(), nodeMap);
+        RCP<coord_multivec_type> newCoordinates = rcp(new coord_multivec_type(nodeMap, coordinates->getNumVectors()));
+        newCoordinates->doImport(*coordinates, nodeImporter, Tpetra::INSERT);
+        coordinates = newCoordinates;
+      }
+
+      mueluParams.set("verbosity", "low");
+      mueluParams.set("number of equations", matrixFile.empty() ? getNumDofsPerNode(matrixType) : 1);
+      mueluParams.set("multigrid algorithm", "sa");
+      mueluParams.set("max levels", 10);
+      mueluParams.set("coarse: max size", 2000);
+      mueluParams.set("coarse: type", "KLU2");
+      mueluParams.set("smoother: type", "CHEBYSHEV");
+      // Time steps keep the prolongators and restrictors and only recompute the coarse
+      // matrices and smoothers; MueLu's default "none" rebuilds the whole hierarchy
+      if (numSteps > 0) mueluParams.set("reuse: type", "RP");
+      if (!mueluXml.empty())
+        Teuchos::updateParametersFromXmlFileAndBroadcast(mueluXml, Teuchos::ptrFromRef(mueluParams), *comm);
+      if (!nullspace.is_null()) mueluParams.sublist("user data").set("Nullspace", nullspace);
+      if (!coordinates.is_null()) mueluParams.sublist("user data").set("Coordinates", coordinates);
+
+      // MueLu deduces its template parameters from an RCP<Tpetra::Operator>
+      RCP<operator_type> opA = Teuchos::rcp_const_cast<crs_matrix_type>(matrix);
+      comm->barrier();
+      precSetupTimer.start(true);
+      mueluPrec = MueLu::CreateTpetraPreconditioner(opA, mueluParams);
+      precSetupTimer.stop();
+    }
+    else if (usePreconditioner)
+    {
+      const std::string ifpack2Type = getIfpack2Type(precType);
+
       /* START OF TODO: Create preconditioner */
-      prec = Ifpack2::Factory::create<row_matrix_type> ("RELAXATION", matrix);
+      prec = Ifpack2::Factory::create<row_matrix_type> (ifpack2Type, matrix);
       /* END OF TODO: Create preconditioner */
       if (prec.is_null ()) {
         *out << "Failed to create Ifpack2 preconditioner!" << std::endl;
@@ -138,17 +528,41 @@ int main(int argc, char *argv[]) {
       // Pass parameters to the preconditioner
       /* START OF TODO: Configure preconditioner */
       ParameterList precParams;
-      precParams.set("relaxation: type", relaxationType);
-      precParams.set("relaxation: sweeps", numSweeps);
-      precParams.set("relaxation: damping factor", damping);
+      if (ifpack2Type == "RELAXATION") {
+        precParams.set("relaxation: type", precType);
+        precParams.set("relaxation: sweeps", numSweeps);
+        precParams.set("relaxation: damping factor", damping);
+      } else if (ifpack2Type == "CHEBYSHEV") {
+        // The largest eigenvalue is estimated by power iterations during compute()
+        precParams.set("chebyshev: degree", polyDegree);
+        precParams.set("chebyshev: eigenvalue max iterations", eigIters);
+        precParams.set("chebyshev: ratio eigenvalue", eigRatio);
+      } else if (ifpack2Type == "SCHWARZ") {
+        precParams.set("schwarz: overlap level", overlap);
+        precParams.set("schwarz: combine mode", "ADD");
+        const std::string innerType = (subdomainSolver == "KLU") ? "AMESOS2" : subdomainSolver;
+        precParams.set("inner preconditioner name", innerType);
+        ParameterList& innerParams = precParams.sublist("inner preconditioner parameters");
+        if (innerType == "AMESOS2") {
+          innerParams.set("Amesos2 solver name", "KLU2");
+        } else {
+          setIncompleteFactorizationParameters(innerType, levelOfFill, dropTol, innerParams);
+        }
+      } else {
+        setIncompleteFactorizationParameters(ifpack2Type, levelOfFill, dropTol, precParams);
+      }
       prec->setParameters(precParams);
       /* END OF TODO: Configure preconditioner */
+      ifpack2Params = precParams;
 
       // Setup the preconditioner
+      comm->barrier();
+      precSetupTimer.start(true);
       /* START OF TODO: Setup the preconditioner */
       prec->initialize();
       prec->compute();
       /* END OF TODO: Setup the preconditioner */
+      precSetupTimer.stop();
     }
 
     // Set up the linear problem to solve.
@@ -162,8 +576,16 @@ int main(int argc, char *argv[]) {
         /* START OF TODO: Insert preconditioner */
         problem->setRightPrec(prec);
         /* END OF TODO: Insert preconditioner */
+      } else if (!mueluPrec.is_null()) {
+        problem->setRightPrec(mueluPrec);
       }
 
+      // Label operator and preconditioner applications as Kokkos profiling regions.
+      // Belos' orthogonalization is labelled through its Teuchos timers.
+      problem->setOperator(rcp(new ProfilingOperator(systemOperator, "ex_03: SpMV")));
+      if (problem->isRightPrec())
+        problem->setRightPrec(rcp(new ProfilingOperator(problem->getRightPrec(), "ex_03: Preconditioner apply")));
+
       /* START OF TODO: Set the linear problem */
       problem->setProblem();
       solver->setProblem(problem);
@@ -175,10 +597,28 @@ int main(int argc, char *argv[]) {
     *out << ">> III. Solve the linear system." << std::endl;
 
     // Solve the linear system.
+    Teuchos::Time& blockSolveTimer = *Teuchos::TimeMonitor::getNewCounter("ex_03: Belos solve");
     {
+      comm->barrier();
+      ReductionCounter::reset();
+      blockSolveTimer.start(true);
       /* START OF TODO: Solve */
       Belos::ReturnType solveResult = solver->solve();
       /* END OF TODO: Solve */
+      blockSolveTimer.stop();
+      const long numReductions = ReductionCounter::get();
+
+      // Write the checkpoint before checking for convergence such that an unconverged
+      // solve can be continued by restarting with --loadCheckpoint.
+      if (!saveCheckpoint.empty()) {
+        Teuchos::Time checkpointTimer("Write checkpoint");
+        comm->barrier();
+        checkpointTimer.start(true);
+        writeCheckpoint(saveCheckpoint, *matrix, *x, *rhs, *xExact, systemSetupTime);
+        checkpointTimer.stop();
+        *out << "Checkpoint '" << saveCheckpoint << "' written: " << getMaxTime(checkpointTimer, *comm) << " s" << std::endl;
+      }
+
       if (solveResult == Belos::Unconverged)
       {
         *out << "Belos did not converge in " << solver->getNumIters() << " iterations." << std::endl;
@@ -190,8 +630,399 @@ int main(int argc, char *argv[]) {
             << " iterations to an achieved tolerance of " << solver->achievedTol()
             << " (< tol = " << tol << ")." << std::endl;
       }
+      *out << "True relative error ||x - x_exact|| / ||x_exact||: " << computeMaxRelativeError(*x, *xExact) << std::endl;
+
+      const double setupTime = getMaxTime(precSetupTimer, *comm);
+      const double solveTime = getMaxTime(blockSolveTimer, *comm);
+      *out << "Preconditioner setup time: " << setupTime << " s" << std::endl;
+      if (!prec.is_null()) {
+        // Ifpack2 keeps track of the time spent in its phases
+        const double initializeTime = getMaxTime(prec->getInitializeTime(), *comm);
+        const double computeTime = getMaxTime(prec->getComputeTime(), *comm);
+        const double applyTime = getMaxTime(prec->getApplyTime(), *comm);
+        const int numApply = prec->getNumApply();
+        *out << "  initialize: " << initializeTime << " s, compute: " << computeTime << " s" << std::endl;
+        *out << "Preconditioner apply time: " << applyTime << " s (" << numApply << " applications, "
+            << (numApply > 0 ? applyTime / numApply : 0.0) << " s per iteration)" << std::endl;
+      }
+      *out << "Solve time: " << solveTime << " s" << std::endl;
+      long maxReductions = 0;
+      Teuchos::reduceAll(*comm, Teuchos::REDUCE_MAX, numReductions, Teuchos::outArg(maxReductions));
+      *out << "Global reductions in solve: " << maxReductions << " ("
+          << static_cast<double>(maxReductions) / std::max(solver->getNumIters(), 1) << " per iteration)" << std::endl;
+      *out << "Setup + solve time: " << setupTime + solveTime << " s" << std::endl;
+
+      if (!overlappingOperator.is_null() && overlappingOperator->getNumApplies() > 0) {
+        // Communication is hidden as far as beginImport() and endImport() take less
+        // time than a blocking Import
+        const int numOpApplies = overlappingOperator->getNumApplies();
+        const double exposedTime = getMaxTime(overlappingOperator->getCommTime(), *comm) / numOpApplies;
+        const double interiorTime = getMaxTime(overlappingOperator->getInteriorTime(), *comm) / numOpApplies;
+        const double boundaryTime = getMaxTime(overlappingOperator->getBoundaryTime(), *comm) / numOpApplies;
+        const double blockingTime = getMaxTime(overlappingOperator->timeBlockingImport(numRHS, numApplies), *comm);
+        const double hidden = blockingTime > 0.0 ? std::max(0.0, 1.0 - exposedTime / blockingTime) : 0.0;
+        *out << "Overlapped SpMV per application: interior " << interiorTime << " s, boundary " << boundaryTime
+            << " s, exposed communication " << exposedTime << " s (blocking Import: " << blockingTime << " s)" << std::endl;
+        *out << "Communication hidden behind the interior SpMV: " << 100.0 * hidden << " %" << std::endl;
+      }
+
+      if (!prec.is_null() && reordering != "none") {
+        // Set up the same preconditioner for the natural ordering and compare
+        RCP<prec_type> naturalPrec = Ifpack2::Factory::create<row_matrix_type>(getIfpack2Type(precType), naturalMatrix);
+        naturalPrec->setParameters(ifpack2Params);
+        naturalPrec->initialize();
+        naturalPrec->compute();
+
+        multivec_type xTest(matrix->getDomainMap(), 1), yTest(matrix->getRangeMap(), 1);
+        multivec_type xNatural(naturalMatrix->getDomainMap(), 1), yNatural(naturalMatrix->getRangeMap(), 1);
+        xTest.randomize();
+        xNatural.randomize();
+        const double fill = getFactorFillRatio(*prec, *matrix);
+        const double naturalFill = getFactorFillRatio(*naturalPrec, *naturalMatrix);
+        const double applyTime = timeApply(*prec, xTest, yTest, numApplies, *comm);
+        const double naturalApplyTime = timeApply(*naturalPrec, xNatural, yNatural, numApplies, *comm);
+
+        *out << "Preconditioner with natural vs. " << reordering << " ordering:" << std::endl;
+        if (fill > 0.0)
+          *out << "  fill ratio nnz(L+U)/nnz(A): " << naturalFill << " vs. " << fill << std::endl;
+        *out << "  compute (factorization): " << getMaxTime(naturalPrec->getComputeTime(), *comm) << " s vs. "
+            << getMaxTime(prec->getComputeTime(), *comm) << " s" << std::endl;
+        *out << "  apply (" << numApplies << " applications): " << naturalApplyTime << " s vs. " << applyTime << " s" << std::endl;
+      }
+    }
+
+    ////////////////////////////////////////////////////////////////////////////
+    ////////////////////////////////////////////////////////////////////////////
+    if (numRHS > 1) {
+      *out << ">> IV. Solve for each of the " << numRHS << " right-hand sides independently." << std::endl;
+
+      // Solve column by column with the same solver type and the same preconditioner
+      Teuchos::Time& singleSolveTimer = *Teuchos::TimeMonitor::getNewCounter("ex_03: Independent Belos solves");
+      int totalIters = 0;
+      for (int j = 0; j < numRHS; ++j) {
+        RCP<multivec_type> xSingle = rcp(new multivec_type(matrix->getDomainMap(), 1));
+        RCP<const multivec_type> rhsSingle = rhs->getVector(j);
+
+        // Operator and preconditioner of section II, i.e. wrapped in the same profiling regions
+        RCP<problem_type> singleProblem = rcp(new problem_type(problem->getOperator(), xSingle, rhsSingle));
+        if (problem->isRightPrec()) singleProblem->setRightPrec(problem->getRightPrec());
+        singleProblem->setProblem();
+
+        Belos::SolverFactory<scalar_type, multivec_type, operator_type> belosFactory;
+        RCP<ParameterList> singleSolverParams = rcp(new ParameterList(*solverParams));
+        if (singleSolverParams->isParameter("Block Size")) singleSolverParams->set("Block Size", 1);
+        RCP<solver_type> singleSolver = belosFactory.create(getBelosSolverName(solverType), singleSolverParams);
+        singleSolver->setProblem(singleProblem);
+
+        comm->barrier();
+        singleSolveTimer.start(false);
+        Belos::ReturnType solveResult = singleSolver->solve();
+        singleSolveTimer.stop();
+        if (solveResult == Belos::Unconverged) {
+          *out << "Belos did not converge for right-hand side " << j << " in " << singleSolver->getNumIters() << " iterations." << std::endl;
+          return EXIT_FAILURE;
+        }
+        totalIters += singleSolver->getNumIters();
+      }
+
+      const double blockTime = getMaxTime(blockSolveTimer, *comm);
+      const double singleTime = getMaxTime(singleSolveTimer, *comm);
+      *out << "Block solve:        " << blockTime << " s (" << blockTime / numRHS << " s per right-hand side, "
+          << solver->getNumIters() << " iterations)" << std::endl;
+      *out << "Independent solves: " << singleTime << " s (" << singleTime / numRHS << " s per right-hand side, "
+          << totalIters << " iterations in total)" << std::endl;
+      *out << "Speedup of block solve over independent solves: " << singleTime / blockTime << std::endl;
+    }
+
+    ////////////////////////////////////////////////////////////////////////////
+    ////////////////////////////////////////////////////////////////////////////
+    if (mixedPrecision) {
+      *out << ">> V. Mixed-precision iterative refinement: outer loop in double, inner " << solverType
+          << " solve in float." << std::endl;
+
+      if (!mueluPrec.is_null()) {
+        *out << "Mixed-precision mode supports the Ifpack2 preconditioners only." << std::endl;
+        return EXIT_FAILURE;
+      }
+      const double doubleResidual = computeMaxRelativeResidual(*systemOperator, *x, *rhs);
+
+      // Single precision copies of matrix and preconditioner halve the memory traffic
+      // of the SpMV and the preconditioner application in the inner solve.
+      Teuchos::Time& mixedSetupTimer = *Teuchos::TimeMonitor::getNewCounter("ex_03: Mixed precision setup");
+      Teuchos::Time& mixedSolveTimer = *Teuchos::TimeMonitor::getNewCounter("ex_03: Mixed precision solve");
+      RCP<const float_crs_matrix_type> matrixFloat = Teuchos::null;
+      RCP<float_prec_type> precFloat = Teuchos::null;
+      comm->barrier();
+      mixedSetupTimer.start(true);
+      matrixFloat = matrix->convert<float>();
+      if (!prec.is_null()) {
+        precFloat = Ifpack2::Factory::create<float_row_matrix_type>(getIfpack2Type(precType), matrixFloat);
+        precFloat->setParameters(ifpack2Params);
+        precFloat->initialize();
+        precFloat->compute();
+      }
+      mixedSetupTimer.stop();
+
+      // The inner solver computes the correction D from the residual R in single precision
+      RCP<multivec_type> xMixed = rcp(new multivec_type(matrix->getDomainMap(), numRHS));
+      RCP<multivec_type> residual = rcp(new multivec_type(matrix->getRangeMap(), numRHS));
+      RCP<multivec_type> correction = rcp(new multivec_type(matrix->getDomainMap(), numRHS));
+      RCP<float_multivec_type> residualFloat = rcp(new float_multivec_type(matrix->getRangeMap(), numRHS));
+      RCP<float_multivec_type> correctionFloat = rcp(new float_multivec_type(matrix->getDomainMap(), numRHS));
+
+      RCP<float_problem_type> innerProblem = rcp(new float_problem_type(matrixFloat, correctionFloat, residualFloat));
+      if (!precFloat.is_null()) innerProblem->setRightPrec(precFloat);
+      innerProblem->setProblem();
+
+      // The inner list is built from the command line options like the list of section II,
+      // since that list holds defaults in double precision after the solver used it.
+      // Belos expects the tolerance in the magnitude type of the scalar type.
+      RCP<ParameterList> innerParams = rcp(new ParameterList());
+      innerParams->set("Verbosity", Belos::Errors + Belos::Warnings + Belos::FinalSummary);
+      innerParams->set("Maximum Iterations", maxIters);
+      innerParams->set("Convergence Tolerance", static_cast<float>(innerTol));
+      if (solverType.find("GMRES") != std::string::npos)
+        innerParams->set("Num Blocks", numBlocks);
+      if (solverType == "GMRES" || solverType == "Block GMRES" || solverType == "Pseudo Block GMRES")
+        innerParams->set("Orthogonalization", orthoType);
+      if (solverType == "s-step GMRES")
+        innerParams->set("Step Size", stepSize);
+      if (solverType == "Block GMRES" || solverType == "Block CG")
+        innerParams->set("Block Size", numRHS);
+      Belos::SolverFactory<float, float_multivec_type, float_operator_type> floatFactory;
+      RCP<float_solver_type> innerSolver = floatFactory.create(getBelosSolverName(solverType), innerParams);
+      innerSolver->setProblem(innerProblem);
+
+      Teuchos::Array<Teuchos::ScalarTraits<scalar_type>::magnitudeType> rhsNorms(numRHS), residualNorms(numRHS);
+      rhs->norm2(rhsNorms());
+      int numRefinements = 0;
+      int innerIters = 0;
+      double mixedResidual = 0.0;
+      comm->barrier();
+      mixedSolveTimer.start(true);
+      while (true) {
+        // R = B - A*X in double precision
+        systemOperator->apply(*xMixed, *residual);
+        residual->update(1.0, *rhs, -1.0);
+        residual->norm2(residualNorms());
+        mixedResidual = 0.0;
+        for (int j = 0; j < numRHS; ++j)
+          mixedResidual = std::max(mixedResidual, static_cast<double>(residualNorms[j] / rhsNorms[j]));
+        if (mixedResidual < tol || numRefinements == maxRefinements) break;
+
+        // Solve A*D = R in single precision and update X += D in double precision.
+        // An unconverged inner solve still yields a useful correction.
+        Tpetra::deep_copy(*residualFloat, *residual);
+        correctionFloat->putScalar(0.0f);
+        innerProblem->setProblem();
+        innerSolver->reset(Belos::Problem);
+        innerSolver->solve();
+        innerIters += innerSolver->getNumIters();
+        Tpetra::deep_copy(*correction, *correctionFloat);
+        xMixed->update(1.0, *correction, 1.0);
+        ++numRefinements;
+      }
+      mixedSolveTimer.stop();
+
+      const double doubleSetupTime = getMaxTime(precSetupTimer, *comm);
+      const double doubleSolveTime = getMaxTime(blockSolveTimer, *comm);
+      const double mixedSetupTime = getMaxTime(mixedSetupTimer, *comm);
+      const double mixedSolveTime = getMaxTime(mixedSolveTimer, *comm);
+      *out << "Double:          setup " << doubleSetupTime << " s, solve " << doubleSolveTime << " s ("
+          << solver->getNumIters() << " iterations), relative residual " << doubleResidual << std::endl;
+      *out << "Mixed precision: setup " << mixedSetupTime << " s, solve " << mixedSolveTime << " s ("
+          << numRefinements << " refinements, " << innerIters << " inner iterations), relative residual "
+          << mixedResidual << std::endl;
+      *out << "Speedup of mixed precision over double solve: " << doubleSolveTime / mixedSolveTime << std::endl;
+      if (mixedResidual >= tol) {
+        *out << "Mixed-precision iterative refinement did not converge in " << maxRefinements << " refinements." << std::endl;
+        return EXIT_FAILURE;
+      }
+    }
+
+    ////////////////////////////////////////////////////////////////////////////
+    ////////////////////////////////////////////////////////////////////////////
+    if (useBlockCrs) {
+      const local_ordinal_type blockSize = getNumDofsPerNode(matrixType);
+      *out << ">> VI. Solve with the matrix in block CRS format (block size " << blockSize << ")." << std::endl;
+
+      if (blockSize == 1 || repartition != "none") {
+        *out << "Block CRS mode requires an elasticity problem with the Galeri distribution." << std::endl;
+        return EXIT_FAILURE;
+      }
+      if (!mueluPrec.is_null()) {
+        *out << "Block CRS mode supports the Ifpack2 preconditioners only." << std::endl;
+        return EXIT_FAILURE;
+      }
+
+      // The rows of all dofs of a mesh node are consecutive in the Galeri dof map and
+      // form one block row of the block matrix.
+      Teuchos::Time& blockConvertTimer = *Teuchos::TimeMonitor::getNewCounter("ex_03: Block CRS conversion");
+      comm->barrier();
+      blockConvertTimer.start(true);
+      RCP<block_crs_matrix_type> blockMatrix = Tpetra::convertToBlockCrsMatrix(*matrix, blockSize);
+      blockConvertTimer.stop();
+      *out << "Conversion to block CRS: " << getMaxTime(blockConvertTimer, *comm) << " s" << std::endl;
+
+      // Memory and SpMV bandwidth. Each apply reads the matrix and the input vector
+      // and writes the output vector once.
+      const double pointMemory = getCrsMatrixMemory(*matrix, *comm);
+      const double blockMemory = getBlockCrsMatrixMemory(*blockMatrix, *comm);
+      const double vectorBytes = 2.0 * matrix->getGlobalNumRows() * sizeof(scalar_type);
+      multivec_type xPoint(matrix->getDomainMap(), 1), yPoint(matrix->getRangeMap(), 1);
+      multivec_type xBlockTest(blockMatrix->getDomainMap(), 1), yBlockTest(blockMatrix->getRangeMap(), 1);
+      xPoint.randomize();
+      xBlockTest.randomize();
+      const double pointApplyTime = timeApply(*matrix, xPoint, yPoint, numApplies, *comm) / numApplies;
+      const double blockApplyTime = timeApply(*blockMatrix, xBlockTest, yBlockTest, numApplies, *comm) / numApplies;
+      *out << "Point CRS: " << pointMemory / 1.0e6 << " MB, SpMV " << pointApplyTime << " s ("
+          << (pointMemory + vectorBytes) / pointApplyTime / 1.0e9 << " GB/s)" << std::endl;
+      *out << "Block CRS: " << blockMemory / 1.0e6 << " MB, SpMV " << blockApplyTime << " s ("
+          << (blockMemory + vectorBytes) / blockApplyTime / 1.0e9 << " GB/s)" << std::endl;
+
+      // Block variants of the preconditioners: relaxation with the inverted diagonal
+      // blocks and block ILU(k)
+      RCP<prec_type> blockPrec = Teuchos::null;
+      Teuchos::Time& blockPrecSetupTimer = *Teuchos::TimeMonitor::getNewCounter("ex_03: Block CRS preconditioner setup");
+      if (!prec.is_null()) {
+        const std::string ifpack2Type = getIfpack2Type(precType);
+        if (ifpack2Type != "RELAXATION" && ifpack2Type != "RILUK") {
+          *out << "Block CRS mode supports the relaxation preconditioners and RILUK only." << std::endl;
+          return EXIT_FAILURE;
+        }
+        blockPrec = Ifpack2::Factory::create<row_matrix_type>(ifpack2Type == "RILUK" ? "RBILUK" : ifpack2Type, blockMatrix);
+        blockPrec->setParameters(ifpack2Params);
+
+        comm->barrier();
+        blockPrecSetupTimer.start(true);
+        blockPrec->initialize();
+        blockPrec->compute();
+        blockPrecSetupTimer.stop();
+      }
+
+      RCP<multivec_type> xBlock = rcp(new multivec_type(blockMatrix->getDomainMap(), numRHS));
+      RCP<problem_type> blockProblem = rcp(new problem_type(blockMatrix, xBlock, rhs));
+      if (!blockPrec.is_null()) blockProblem->setRightPrec(blockPrec);
+      blockProblem->setProblem();
+
+      Belos::SolverFactory<scalar_type, multivec_type, operator_type> belosFactory;
+      RCP<solver_type> blockSolver = belosFactory.create(getBelosSolverName(solverType), rcp(new ParameterList(*solverParams)));
+      blockSolver->setProblem(blockProblem);
+
+      Teuchos::Time& blockCrsSolveTimer = *Teuchos::TimeMonitor::getNewCounter("ex_03: Block CRS Belos solve");
+      comm->barrier();
+      blockCrsSolveTimer.start(true);
+      Belos::ReturnType solveResult = blockSolver->solve();
+      blockCrsSolveTimer.stop();
+      if (solveResult == Belos::Unconverged) {
+        *out << "Belos did not converge with the block CRS matrix in " << blockSolver->getNumIters() << " iterations." << std::endl;
+        return EXIT_FAILURE;
+      }
+
+      const double pointSetupTime = getMaxTime(precSetupTimer, *comm);
+      const double pointSolveTime = getMaxTime(blockSolveTimer, *comm);
+      const double blockSetupTime = getMaxTime(blockPrecSetupTimer, *comm);
+      const double blockSolveTime = getMaxTime(blockCrsSolveTimer, *comm);
+      *out << "Point CRS: preconditioner setup " << pointSetupTime << " s, solve " << pointSolveTime << " s ("
+          << solver->getNumIters() << " iterations)" << std::endl;
+      *out << "Block CRS: preconditioner setup " << blockSetupTime << " s, solve " << blockSolveTime << " s ("
+          << blockSolver->getNumIters() << " iterations)" << std::endl;
+      *out << "Speedup of block CRS over point CRS solve: " << pointSolveTime / blockSolveTime << std::endl;
     }
 
+    ////////////////////////////////////////////////////////////////////////////
+    ////////////////////////////////////////////////////////////////////////////
+    if (numSteps > 0) {
+      *out << ">> VII. Time stepping: re-solve " << numSteps << " times with updated matrix values." << std::endl;
+      if (!mueluPrec.is_null())
+        *out << "MueLu reuse type: " << mueluParams.get<std::string>("reuse: type", "none") << std::endl;
+
+      // The graph of the matrix stays the same in every step. Thus, only the numerical
+      // setup of the preconditioner is redone (for MueLu, as far as its reuse type
+      // allows), the Belos solver is reused and the solution of the previous step
+      // serves as initial guess.
+      RCP<crs_matrix_type> stepMatrix = Teuchos::rcp_const_cast<crs_matrix_type>(matrix);
+      Teuchos::Time& stepComputeTimer = *Teuchos::TimeMonitor::getNewCounter("ex_03: Time step preconditioner compute");
+      Teuchos::Time& stepSolveTimer = *Teuchos::TimeMonitor::getNewCounter("ex_03: Time step Belos solve");
+      int stepIters = 0;
+      for (int step = 1; step <= numSteps; ++step) {
+        updateMatrixValues(*stepMatrix, step);
+
+        comm->barrier();
+        stepComputeTimer.start(false);
+        if (!prec.is_null()) {
+          prec->compute();
+        } else if (!mueluPrec.is_null()) {
+          using muelu_operator_type = MueLu::TpetraOperator<scalar_type, local_ordinal_type, global_ordinal_type, node_type>;
+          MueLu::ReuseTpetraPreconditioner(stepMatrix, *Teuchos::rcp_dynamic_cast<muelu_operator_type>(mueluPrec, true));
+        }
+        stepComputeTimer.stop();
+
+        comm->barrier();
+        stepSolveTimer.start(false);
+        problem->setProblem(x, rhs);
+        solver->reset(Belos::Problem);
+        Belos::ReturnType solveResult = solver->solve();
+        stepSolveTimer.stop();
+        if (solveResult == Belos::Unconverged) {
+          *out << "Belos did not converge in time step " << step << " in " << solver->getNumIters() << " iterations." << std::endl;
+          return EXIT_FAILURE;
+        }
+        stepIters += solver->getNumIters();
+      }
+
+      // For comparison, a cold start on the final matrix: full preconditioner setup,
+      // a new Belos solver and a zero initial guess
+      Teuchos::Time& coldSetupTimer = *Teuchos::TimeMonitor::getNewCounter("ex_03: Cold start preconditioner setup");
+      Teuchos::Time& coldSolveTimer = *Teuchos::TimeMonitor::getNewCounter("ex_03: Cold start Belos solve");
+      RCP<multivec_type> xCold = rcp(new multivec_type(matrix->getDomainMap(), numRHS));
+      RCP<operator_type> coldPrec = Teuchos::null;
+
+      comm->barrier();
+      coldSetupTimer.start(true);
+      if (!prec.is_null()) {
+        prec->initialize();
+        prec->compute();
+        coldPrec = prec;
+      } else if (!mueluPrec.is_null()) {
+        RCP<operator_type> opStep = stepMatrix;
+        coldPrec = MueLu::CreateTpetraPreconditioner(opStep, mueluParams);
+      }
+      coldSetupTimer.stop();
+
+      RCP<problem_type> coldProblem = rcp(new problem_type(systemOperator, xCold, rhs));
+      if (!coldPrec.is_null()) coldProblem->setRightPrec(coldPrec);
+      coldProblem->setProblem();
+      Belos::SolverFactory<scalar_type, multivec_type, operator_type> belosFactory;
+      RCP<solver_type> coldSolver = belosFactory.create(getBelosSolverName(solverType), rcp(new ParameterList(*solverParams)));
+      coldSolver->setProblem(coldProblem);
+
+      // Only the solve is timed, as for the time steps
+      comm->barrier();
+      coldSolveTimer.start(true);
+      Belos::ReturnType solveResult = coldSolver->solve();
+      coldSolveTimer.stop();
+      if (solveResult == Belos::Unconverged) {
+        *out << "Belos did not converge for the cold start in " << coldSolver->getNumIters() << " iterations." << std::endl;
+        return EXIT_FAILURE;
+      }
+
+      const double stepComputeTime = getMaxTime(stepComputeTimer, *comm) / numSteps;
+      const double stepSolveTime = getMaxTime(stepSolveTimer, *comm) / numSteps;
+      const double coldSetupTime = getMaxTime(coldSetupTimer, *comm);
+      const double coldSolveTime = getMaxTime(coldSolveTimer, *comm);
+      *out << "Time step (average): " << stepComputeTime + stepSolveTime << " s (preconditioner compute: " << stepComputeTime
+          << " s, solve: " << stepSolveTime << " s, " << static_cast<double>(stepIters) / numSteps << " iterations)" << std::endl;
+      *out << "Cold start:          " << coldSetupTime + coldSolveTime << " s (preconditioner setup: " << coldSetupTime
+          << " s, solve: " << coldSolveTime << " s, " << coldSolver->getNumIters() << " iterations)" << std::endl;
+      *out << "Speedup of time step over cold start: " << (coldSetupTime + coldSolveTime) / (stepComputeTime + stepSolveTime) << std::endl;
+    }
+
+    // Timings of all phases (minimum, mean and maximum over all ranks)
+    *out << std::endl;
+    Teuchos::TimeMonitor::summarize(comm.ptr(), *out, false, true, false);
+    if (!timingReport.empty()) writeTimingReport(timingReport, comm);
+
     return EXIT_SUCCESS;
   }
 }
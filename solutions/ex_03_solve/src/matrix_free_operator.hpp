@@ -0,0 +1,263 @@
+#ifndef _MATRIX_FREE_OPERATOR_
+#define _MATRIX_FREE_OPERATOR_
+
+#include "utils.hpp"
+
+#include <algorithm>
+#include <string>
+
+#include <Galeri_XpetraMaps.hpp>
+
+#include <Kokkos_Core.hpp>
+
+#include <Teuchos_Array.hpp>
+#include <Teuchos_Comm.hpp>
+#include <Teuchos_OrdinalTraits.hpp>
+#include <Teuchos_ParameterList.hpp>
+#include <Teuchos_RCP.hpp>
+#include <Teuchos_TestForException.hpp>
+
+#include <Tpetra_Import.hpp>
+#include <Tpetra_Map.hpp>
+#include <Tpetra_MultiVector.hpp>
+#include <Tpetra_Operator.hpp>
+
+#include <Xpetra_Map.hpp>
+#include <Xpetra_TpetraMap.hpp>
+
+/* Matrix-free application of the Galeri Laplace2D and Laplace3D stencils.
+ *
+ * The operator uses the same Cartesian node map as buildMatrix(), where every rank
+ * owns a box of the structured grid. The ghosted input vector covers this box plus
+ * one layer of neighbor nodes and is filled by a Tpetra::Import. Thus, all stencil
+ * neighbors of a node are found at constant strides in the ghosted vector and no
+ * index arrays have to be read. Interior nodes of the global grid are handled by a
+ * branch-free kernel, nodes on the global boundary by a separate kernel replicating
+ * Galeri's treatment of Dirichlet and Neumann boundaries.
+ */
+class MatrixFreeStencilOperator : public Tpetra::Operator<Scalar,LocalOrdinal,GlobalOrdinal,Node> {
+public:
+  using map_type = Tpetra::Map<LocalOrdinal,GlobalOrdinal,Node>;
+  using multivec_type = Tpetra::MultiVector<Scalar,LocalOrdinal,GlobalOrdinal,Node>;
+  using import_type = Tpetra::Import<LocalOrdinal,GlobalOrdinal,Node>;
+  using execution_space = typename multivec_type::execution_space;
+  using box_policy = Kokkos::MDRangePolicy<execution_space, Kokkos::Rank<3>>;
+
+  MatrixFreeStencilOperator(Teuchos::ParameterList& galeriList, RCP<const Teuchos::Comm<int>> comm)
+  {
+    using XMap = Xpetra::Map<LocalOrdinal,GlobalOrdinal,Node>;
+    using XTpetraMap = Xpetra::TpetraMap<LocalOrdinal,GlobalOrdinal,Node>;
+
+    const std::string matrixType = galeriList.get<std::string>("matrixType");
+    TEUCHOS_TEST_FOR_EXCEPTION(matrixType != "Laplace2D" && matrixType != "Laplace3D", std::invalid_argument,
+        "MatrixFreeStencilOperator supports Laplace2D and Laplace3D only, but got " << matrixType << ".");
+    is3D_ = (matrixType == "Laplace3D");
+
+    nx_ = galeriList.get<GlobalOrdinal>("nx");
+    ny_ = galeriList.get<GlobalOrdinal>("ny");
+    nz_ = is3D_ ? galeriList.get<GlobalOrdinal>("nz") : 1;
+    diag_ = is3D_ ? 6.0 : 4.0;
+
+    // Boundary conditions with the same defaults as in Galeri. Note that Galeri calls the
+    // y-boundaries front/back and the z-boundaries bottom/top in 3D.
+    dirichletXMin_ = galeriList.get<std::string>("left boundary", "Dirichlet") == "Dirichlet";
+    dirichletXMax_ = galeriList.get<std::string>("right boundary", "Dirichlet") == "Dirichlet";
+    dirichletYMin_ = galeriList.get<std::string>(is3D_ ? "front boundary" : "bottom boundary", "Dirichlet") == "Dirichlet";
+    dirichletYMax_ = galeriList.get<std::string>(is3D_ ? "back boundary" : "top boundary", "Dirichlet") == "Dirichlet";
+    dirichletZMin_ = is3D_ && galeriList.get<std::string>("bottom boundary", "Dirichlet") == "Dirichlet";
+    dirichletZMax_ = is3D_ && galeriList.get<std::string>("top boundary", "Dirichlet") == "Dirichlet";
+    keepBCs_ = galeriList.get<bool>("keepBCs", false);
+
+    RCP<const XMap> nodeMap = Galeri::Xpetra::CreateMap<LocalOrdinal,GlobalOrdinal,Node>(
+        Xpetra::UseTpetra, getGridType(matrixType), comm, galeriList);
+    map_ = Teuchos::rcp_dynamic_cast<const XTpetraMap>(nodeMap, true)->getTpetra_Map();
+
+    // Determine the box of grid nodes owned by this rank
+    const LocalOrdinal numMyNodes = static_cast<LocalOrdinal>(map_->getLocalNumElements());
+    lo_[0] = nx_; lo_[1] = ny_; lo_[2] = nz_;
+    hi_[0] = -1;  hi_[1] = -1;  hi_[2] = -1;
+    for (LocalOrdinal lid = 0; lid < numMyNodes; ++lid) {
+      GlobalOrdinal ijk[3];
+      getGridIndices(map_->getGlobalElement(lid), ijk);
+      for (int d = 0; d < 3; ++d) {
+        lo_[d] = std::min(lo_[d], ijk[d]);
+        hi_[d] = std::max(hi_[d], ijk[d]);
+      }
+    }
+    if (numMyNodes == 0) {
+      for (int d = 0; d < 3; ++d) { lo_[d] = 0; hi_[d] = -1; }
+    }
+
+    // The kernels rely on the lexicographic ordering of the owned box
+    for (LocalOrdinal lid = 0; lid < numMyNodes; ++lid) {
+      GlobalOrdinal ijk[3];
+      getGridIndices(map_->getGlobalElement(lid), ijk);
+      const GlobalOrdinal expected = (ijk[0] - lo_[0]) + (hi_[0] - lo_[0] + 1) * ((ijk[1] - lo_[1]) + (hi_[1] - lo_[1] + 1) * (ijk[2] - lo_[2]));
+      TEUCHOS_TEST_FOR_EXCEPTION(expected != lid, std::runtime_error,
+          "MatrixFreeStencilOperator requires each rank to own a lexicographically ordered box of the grid.");
+    }
+
+    // Ghosted box: owned box plus one layer of neighbor nodes inside the global grid
+    const GlobalOrdinal n[3] = {nx_, ny_, nz_};
+    for (int d = 0; d < 3; ++d) {
+      ghostLo_[d] = (numMyNodes > 0) ? std::max<GlobalOrdinal>(lo_[d] - 1, 0) : 0;
+      ghostHi_[d] = (numMyNodes > 0) ? std::min<GlobalOrdinal>(hi_[d] + 1, n[d] - 1) : -1;
+    }
+    Teuchos::Array<GlobalOrdinal> colIndices;
+    if (numMyNodes > 0) {
+      for (GlobalOrdinal k = ghostLo_[2]; k <= ghostHi_[2]; ++k)
+        for (GlobalOrdinal j = ghostLo_[1]; j <= ghostHi_[1]; ++j)
+          for (GlobalOrdinal i = ghostLo_[0]; i <= ghostHi_[0]; ++i)
+            colIndices.push_back(i + nx_ * (j + ny_ * k));
+    }
+    colMap_ = rcp(new map_type(Teuchos::OrdinalTraits<Tpetra::global_size_t>::invalid(),
+        colIndices(), map_->getIndexBase(), comm));
+    importer_ = rcp(new import_type(map_, colMap_));
+  }
+
+  RCP<const map_type> getDomainMap() const override { return map_; }
+  RCP<const map_type> getRangeMap() const override { return map_; }
+  bool hasTransposeApply() const override { return false; }
+
+  // Y = beta*Y + alpha*A*X
+  void apply(const multivec_type& X, multivec_type& Y, Teuchos::ETransp mode = Teuchos::NO_TRANS,
+      Scalar alpha = Teuchos::ScalarTraits<Scalar>::one(), Scalar beta = Teuchos::ScalarTraits<Scalar>::zero()) const override
+  {
+    TEUCHOS_TEST_FOR_EXCEPTION(mode != Teuchos::NO_TRANS, std::logic_error,
+        "MatrixFreeStencilOperator does not support transposed application.");
+
+    const size_t numVecs = X.getNumVectors();
+    if (colX_.is_null() || colX_->getNumVectors() != numVecs)
+      colX_ = rcp(new multivec_type(colMap_, numVecs, false));
+
+    // Halo exchange
+    colX_->doImport(X, *importer_, Tpetra::INSERT);
+
+    if (map_->getLocalNumElements() == 0) return;
+
+    // The local view of a column subview with non-constant stride covers the columns of
+    // the underlying multivector, so such a Y is computed in a constant-stride copy
+    multivec_type* constY = &Y;
+    if (!Y.isConstantStride()) {
+      if (constY_.is_null() || constY_->getNumVectors() != numVecs)
+        constY_ = rcp(new multivec_type(map_, numVecs, false));
+      if (beta != Teuchos::ScalarTraits<Scalar>::zero())
+        Tpetra::deep_copy(*constY_, Y);
+      constY = constY_.get();
+    }
+
+    const auto x = colX_->getLocalViewDevice(Tpetra::Access::ReadOnly);
+    const auto y = constY->getLocalViewDevice(Tpetra::Access::ReadWrite);
+
+    // Strides of the owned box (y) and the ghosted box (x)
+    const LocalOrdinal by = hi_[0] - lo_[0] + 1;
+    const LocalOrdinal bz = by * (hi_[1] - lo_[1] + 1);
+    const LocalOrdinal sy = ghostHi_[0] - ghostLo_[0] + 1;
+    const LocalOrdinal sz = sy * (ghostHi_[1] - ghostLo_[1] + 1);
+
+    // Offsets of the owned box in grid and ghosted box coordinates
+    const GlobalOrdinal lo0 = lo_[0], lo1 = lo_[1], lo2 = lo_[2];
+    const GlobalOrdinal g0 = ghostLo_[0], g1 = ghostLo_[1], g2 = ghostLo_[2];
+    const GlobalOrdinal nx = nx_, ny = ny_, nz = nz_;
+    const bool is3D = is3D_;
+    const Scalar diag = diag_;
+    const bool betaIsZero = (beta == Teuchos::ScalarTraits<Scalar>::zero());
+
+    // Interior nodes of the global grid: all neighbors exist, the row is the plain stencil
+    const GlobalOrdinal iLo = std::max<GlobalOrdinal>(lo_[0], 1), iHi = std::min<GlobalOrdinal>(hi_[0], nx_ - 2);
+    const GlobalOrdinal jLo = std::max<GlobalOrdinal>(lo_[1], 1), jHi = std::min<GlobalOrdinal>(hi_[1], ny_ - 2);
+    const GlobalOrdinal kLo = is3D_ ? std::max<GlobalOrdinal>(lo_[2], 1) : 0;
+    const GlobalOrdinal kHi = is3D_ ? std::min<GlobalOrdinal>(hi_[2], nz_ - 2) : 0;
+    if (iLo <= iHi && jLo <= jHi && kLo <= kHi) {
+      Kokkos::parallel_for("MatrixFreeStencilOperator::interior",
+        box_policy({kLo, jLo, iLo}, {kHi + 1, jHi + 1, iHi + 1}),
+        KOKKOS_LAMBDA(const GlobalOrdinal k, const GlobalOrdinal j, const GlobalOrdinal i) {
+          const LocalOrdinal row = (i - lo0) + by * (j - lo1) + bz * (k - lo2);
+          const LocalOrdinal c = (i - g0) + sy * (j - g1) + sz * (k - g2);
+          for (size_t v = 0; v < numVecs; ++v) {
+            Scalar ax = diag * x(c, v) - x(c - 1, v) - x(c + 1, v) - x(c - sy, v) - x(c + sy, v);
+            if (is3D) ax -= x(c - sz, v) + x(c + sz, v);
+            y(row, v) = betaIsZero ? alpha * ax : alpha * ax + beta * y(row, v);
+          }
+        });
+    }
+
+    // Nodes on the global boundary
+    const bool dirXMin = dirichletXMin_, dirXMax = dirichletXMax_;
+    const bool dirYMin = dirichletYMin_, dirYMax = dirichletYMax_;
+    const bool dirZMin = dirichletZMin_, dirZMax = dirichletZMax_;
+    const bool keepBCs = keepBCs_;
+    Kokkos::parallel_for("MatrixFreeStencilOperator::boundary",
+      box_policy({lo_[2], lo_[1], lo_[0]}, {hi_[2] + 1, hi_[1] + 1, hi_[0] + 1}),
+      KOKKOS_LAMBDA(const GlobalOrdinal k, const GlobalOrdinal j, const GlobalOrdinal i) {
+        const bool hasXMin = (i > 0), hasXMax = (i < nx - 1);
+        const bool hasYMin = (j > 0), hasYMax = (j < ny - 1);
+        const bool hasZMin = is3D && (k > 0), hasZMax = is3D && (k < nz - 1);
+        const bool isBoundary = !hasXMin || !hasXMax || !hasYMin || !hasYMax || (is3D && (!hasZMin || !hasZMax));
+        if (!isBoundary) return;
+
+        const bool isDirichlet = (!hasXMin && dirXMin) || (!hasXMax && dirXMax) ||
+                                 (!hasYMin && dirYMin) || (!hasYMax && dirYMax) ||
+                                 (is3D && ((!hasZMin && dirZMin) || (!hasZMax && dirZMax)));
+        const int numNeighbors = hasXMin + hasXMax + hasYMin + hasYMax + hasZMin + hasZMax;
+
+        const LocalOrdinal row = (i - lo0) + by * (j - lo1) + bz * (k - lo2);
+        const LocalOrdinal c = (i - g0) + sy * (j - g1) + sz * (k - g2);
+        for (size_t v = 0; v < numVecs; ++v) {
+          Scalar ax = 0.0;
+          if (isDirichlet && !keepBCs) {
+            // Eliminated Dirichlet node: diagonal entry only
+            ax = diag * x(c, v);
+          } else {
+            // Neumann node: the diagonal is the negative sum of the off-diagonal entries
+            ax = (isDirichlet ? diag : static_cast<Scalar>(numNeighbors)) * x(c, v);
+            if (hasXMin) ax -= x(c - 1, v);
+            if (hasXMax) ax -= x(c + 1, v);
+            if (hasYMin) ax -= x(c - sy, v);
+            if (hasYMax) ax -= x(c + sy, v);
+            if (hasZMin) ax -= x(c - sz, v);
+            if (hasZMax) ax -= x(c + sz, v);
+          }
+          y(row, v) = betaIsZero ? alpha * ax : alpha * ax + beta * y(row, v);
+        }
+      });
+
+    if (constY != &Y)
+      Tpetra::deep_copy(Y, *constY);
+  }
+
+  // Number of halo entries (per vector) this rank receives in every apply()
+  size_t getNumHaloEntries() const { return importer_->getNumRemoteIDs(); }
+
+  // Bytes of operator data on this rank per vector: the ghosted copy of the input vector
+  size_t getLocalMemoryBytes() const { return colMap_->getLocalNumElements() * sizeof(Scalar); }
+
+private:
+  // Grid indices (i, j, k) of a node
+  void getGridIndices(const GlobalOrdinal gid, GlobalOrdinal ijk[3]) const
+  {
+    ijk[0] = gid % nx_;
+    ijk[1] = (gid / nx_) % ny_;
+    ijk[2] = gid / (nx_ * ny_);
+  }
+
+  RCP<const map_type> map_;
+  RCP<const map_type> colMap_;
+  RCP<const import_type> importer_;
+  mutable RCP<multivec_type> colX_;
+  mutable RCP<multivec_type> constY_;
+
+  bool is3D_ = false;
+  GlobalOrdinal nx_ = 0, ny_ = 0, nz_ = 0;
+  Scalar diag_ = 0.0;
+  bool dirichletXMin_ = true, dirichletXMax_ = true;
+  bool dirichletYMin_ = true, dirichletYMax_ = true;
+  bool dirichletZMin_ = true, dirichletZMax_ = true;
+  bool keepBCs_ = false;
+
+  // Owned and ghosted box in grid indices (inclusive bounds)
+  GlobalOrdinal lo_[3], hi_[3];
+  GlobalOrdinal ghostLo_[3], ghostHi_[3];
+};
+
+#endif
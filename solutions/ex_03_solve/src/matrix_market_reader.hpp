@@ -0,0 +1,243 @@
+#ifndef _MATRIX_MARKET_READER_
+#define _MATRIX_MARKET_READER_
+
+#include "utils.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <Teuchos_Comm.hpp>
+#include <Teuchos_CommHelpers.hpp>
+#include <Teuchos_OrdinalTraits.hpp>
+#include <Teuchos_RCP.hpp>
+#include <Teuchos_TestForException.hpp>
+#include <Teuchos_TimeMonitor.hpp>
+
+#include <Tpetra_CrsMatrix.hpp>
+#include <Tpetra_Export.hpp>
+#include <Tpetra_Map.hpp>
+
+/* Parallel reader for sparse matrices in MatrixMarket coordinate format.
+ *
+ * Tpetra::MatrixMarket::Reader parses the whole file on rank 0 and scatters the
+ * entries afterwards. Here, rank 0 only parses the header. The data section is split
+ * into one byte range per rank; every rank memory-maps the file, parses the lines
+ * starting in its own range chunk by chunk and releases the parsed pages again. The
+ * entries are collected in a matrix on the rows found locally and routed to the
+ * owning ranks of a uniform contiguous row map with a Tpetra::Export.
+ *
+ * Supported are real, integer and pattern matrices in general or symmetric storage.
+ * Global indices are 0-based.
+ */
+
+// Parse the next whitespace-separated token of a line [pos, lineEnd) as a number
+template <class T>
+bool parseMatrixMarketToken(const char*& pos, const char* lineEnd, T& value)
+{
+  while (pos < lineEnd && (*pos == ' ' || *pos == '\t' || *pos == '\r')) ++pos;
+  const char* tokenEnd = pos;
+  while (tokenEnd < lineEnd && *tokenEnd != ' ' && *tokenEnd != '\t' && *tokenEnd != '\r') ++tokenEnd;
+
+  // The mapped file is not null-terminated, so the token is copied before conversion
+  char token[64];
+  const size_t length = tokenEnd - pos;
+  if (length == 0 || length >= sizeof(token)) return false;
+  std::memcpy(token, pos, length);
+  token[length] = '\0';
+  pos = tokenEnd;
+
+  char* end = nullptr;
+  if (std::is_integral<T>::value) value = static_cast<T>(std::strtoll(token, &end, 10));
+  else value = static_cast<T>(std::strtod(token, &end));
+  return end == token + length;
+}
+
+RCP<const Tpetra::CrsMatrix<Scalar,LocalOrdinal,GlobalOrdinal,Node>>
+readMatrixMarketParallel(const std::string& fileName, RCP<const Teuchos::Comm<int>> comm,
+    const size_t chunkBytes = size_t(64) << 20)
+{
+  using crs_matrix_type = Tpetra::CrsMatrix<Scalar,LocalOrdinal,GlobalOrdinal,Node>;
+  using map_type = Tpetra::Map<LocalOrdinal,GlobalOrdinal,Node>;
+  using export_type = Tpetra::Export<LocalOrdinal,GlobalOrdinal,Node>;
+
+  struct Entry {
+    GlobalOrdinal row;
+    GlobalOrdinal col;
+    Scalar value;
+  };
+
+  // Rank 0 parses the header: banner, comments and size line
+  long long header[5] = {0, 0, 0, 0, 0}; // numRows, numCols, numEntries, offset of data, symmetric
+  int isPattern = 0;
+  int headerError = 0;
+  if (comm->getRank() == 0) {
+    std::ifstream file(fileName);
+    std::string line;
+    if (!file || !std::getline(file, line) || line.compare(0, 14, "%%MatrixMarket") != 0) {
+      headerError = 1;
+    } else {
+      std::istringstream banner(line);
+      std::string tag, object, format, field, symmetry;
+      banner >> tag >> object >> format >> field >> symmetry;
+      std::transform(field.begin(), field.end(), field.begin(), ::tolower);
+      std::transform(symmetry.begin(), symmetry.end(), symmetry.begin(), ::tolower);
+      if (format != "coordinate" || (field != "real" && field != "integer" && field != "pattern")
+          || (symmetry != "general" && symmetry != "symmetric"))
+        headerError = 2;
+      isPattern = (field == "pattern");
+      header[4] = (symmetry == "symmetric");
+      while (std::getline(file, line) && (line.empty() || line[0] == '%'));
+      std::istringstream sizes(line);
+      if (!(sizes >> header[0] >> header[1] >> header[2]) || header[0] != header[1])
+        headerError = 3;
+      header[3] = file.tellg();
+    }
+  }
+  Teuchos::broadcast(*comm, 0, &headerError);
+  TEUCHOS_TEST_FOR_EXCEPTION(headerError == 1, std::runtime_error, "Cannot read MatrixMarket file " << fileName << ".");
+  TEUCHOS_TEST_FOR_EXCEPTION(headerError == 2, std::runtime_error, fileName << " is not a real, integer or pattern "
+      "MatrixMarket matrix in general or symmetric coordinate format.");
+  TEUCHOS_TEST_FOR_EXCEPTION(headerError == 3, std::runtime_error, fileName << " has no valid size line of a square matrix.");
+  Teuchos::broadcast(*comm, 0, 5, header);
+  Teuchos::broadcast(*comm, 0, &isPattern);
+
+  const GlobalOrdinal numRows = header[0];
+  const size_t dataBegin = header[3];
+  const bool isSymmetric = header[4];
+
+  std::vector<Entry> entries;
+  {
+    static RCP<Teuchos::Time> parseTimer = Teuchos::TimeMonitor::getNewCounter("ex_03: MatrixMarket parse");
+    Teuchos::TimeMonitor parseMonitor(*parseTimer);
+
+    // Errors are only thrown after all ranks agreed on them, otherwise the ranks
+    // without error would wait for the others in the reduction below.
+    int lclError = 0, gblError = 0;
+    size_t fileSize = 0;
+    char* data = static_cast<char*>(MAP_FAILED);
+    const int fd = open(fileName.c_str(), O_RDONLY);
+    if (fd >= 0) {
+      struct stat fileStat;
+      fstat(fd, &fileStat);
+      fileSize = fileStat.st_size;
+      data = static_cast<char*>(mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0));
+      close(fd);
+    }
+    if (data == MAP_FAILED) {
+      lclError = 1;
+      fileSize = 0;
+    }
+
+    // A rank parses all lines starting in [begin, end). Range boundaries inside a
+    // line are moved to the start of the next line, such that every line is parsed
+    // by exactly one rank.
+    auto getLineStart = [&](const size_t nominal) {
+      if (nominal <= dataBegin) return dataBegin;
+      if (nominal >= fileSize) return fileSize;
+      const char* newline = static_cast<const char*>(std::memchr(data + nominal - 1, '\n', fileSize - nominal + 1));
+      return newline ? static_cast<size_t>(newline - data) + 1 : fileSize;
+    };
+    const size_t numDataBytes = fileSize - std::min(dataBegin, fileSize);
+    const size_t rank = comm->getRank(), numRanks = comm->getSize();
+    const size_t begin = getLineStart(dataBegin + numDataBytes * rank / numRanks);
+    const size_t end = getLineStart(dataBegin + numDataBytes * (rank + 1) / numRanks);
+
+    if (!lclError) madvise(data, fileSize, MADV_SEQUENTIAL);
+    entries.reserve((end - begin) / 20 * (isSymmetric ? 2 : 1));
+    const size_t pageSize = sysconf(_SC_PAGESIZE);
+    size_t pos = begin;
+    size_t releasedUntil = begin / pageSize * pageSize;
+    bool isValid = true;
+    while (pos < end && isValid) {
+      const size_t chunkEnd = std::min(pos + chunkBytes, end);
+      while (pos < chunkEnd) {
+        const char* lineBegin = data + pos;
+        const char* newline = static_cast<const char*>(std::memchr(lineBegin, '\n', fileSize - pos));
+        const char* lineEnd = newline ? newline : data + fileSize;
+        pos = (lineEnd - data) + 1;
+
+        const char* p = lineBegin;
+        while (p < lineEnd && (*p == ' ' || *p == '\t' || *p == '\r')) ++p;
+        if (p == lineEnd || *p == '%') continue;
+
+        Entry entry;
+        entry.value = Teuchos::ScalarTraits<Scalar>::one();
+        isValid = parseMatrixMarketToken(p, lineEnd, entry.row) && parseMatrixMarketToken(p, lineEnd, entry.col)
+            && (isPattern || parseMatrixMarketToken(p, lineEnd, entry.value))
+            && entry.row >= 1 && entry.row <= numRows && entry.col >= 1 && entry.col <= numRows;
+        if (!isValid) break;
+        --entry.row;
+        --entry.col;
+        entries.push_back(entry);
+        if (isSymmetric && entry.row != entry.col)
+          entries.push_back(Entry{entry.col, entry.row, entry.value});
+      }
+
+      // Drop the pages parsed so far from memory
+      const size_t releaseEnd = std::min(pos, end) / pageSize * pageSize;
+      if (releaseEnd > releasedUntil) {
+        madvise(data + releasedUntil, releaseEnd - releasedUntil, MADV_DONTNEED);
+        releasedUntil = releaseEnd;
+      }
+    }
+    if (!lclError) munmap(data, fileSize);
+
+    if (!isValid) lclError = 2;
+    Teuchos::reduceAll(*comm, Teuchos::REDUCE_MAX, lclError, Teuchos::outArg(gblError));
+    TEUCHOS_TEST_FOR_EXCEPTION(gblError == 1, std::runtime_error, "Cannot open or map " << fileName << " on all ranks.");
+    TEUCHOS_TEST_FOR_EXCEPTION(gblError == 2, std::runtime_error, "Invalid or out-of-range entry in MatrixMarket file " << fileName << ".");
+  }
+
+  static RCP<Teuchos::Time> exportTimer = Teuchos::TimeMonitor::getNewCounter("ex_03: MatrixMarket export");
+  Teuchos::TimeMonitor exportMonitor(*exportTimer);
+
+  // Matrix on the rows found on this rank. Rows may be found on several ranks.
+  std::sort(entries.begin(), entries.end(),
+      [](const Entry& a, const Entry& b) { return a.row < b.row || (a.row == b.row && a.col < b.col); });
+  std::vector<GlobalOrdinal> rowGids, colGids(entries.size());
+  std::vector<size_t> numEntriesPerRow;
+  std::vector<Scalar> values(entries.size());
+  for (size_t k = 0; k < entries.size(); ++k) {
+    if (rowGids.empty() || rowGids.back() != entries[k].row) {
+      rowGids.push_back(entries[k].row);
+      numEntriesPerRow.push_back(0);
+    }
+    ++numEntriesPerRow.back();
+    colGids[k] = entries[k].col;
+    values[k] = entries[k].value;
+  }
+  std::vector<Entry>().swap(entries);
+
+  const Tpetra::global_size_t invalid = Teuchos::OrdinalTraits<Tpetra::global_size_t>::invalid();
+  RCP<const map_type> sourceMap = rcp(new map_type(invalid, Teuchos::ArrayView<const GlobalOrdinal>(rowGids), 0, comm));
+  RCP<const map_type> targetMap = rcp(new map_type(numRows, 0, comm));
+
+  crs_matrix_type source(sourceMap, Teuchos::ArrayView<const size_t>(numEntriesPerRow));
+  size_t offset = 0;
+  for (size_t i = 0; i < rowGids.size(); ++i) {
+    source.insertGlobalValues(rowGids[i], Teuchos::ArrayView<const GlobalOrdinal>(&colGids[offset], numEntriesPerRow[i]),
+        Teuchos::ArrayView<const Scalar>(&values[offset], numEntriesPerRow[i]));
+    offset += numEntriesPerRow[i];
+  }
+  source.fillComplete(targetMap, targetMap);
+
+  // Route the rows to their owners, summing up rows found on several ranks
+  export_type exporter(sourceMap, targetMap);
+  RCP<crs_matrix_type> A = rcp(new crs_matrix_type(targetMap, 0));
+  A->doExport(source, exporter, Tpetra::ADD);
+  A->fillComplete(targetMap, targetMap);
+  return A;
+}
+
+#endif
@@ -0,0 +1,218 @@
+#ifndef _OVERLAPPING_OPERATOR_
+#define _OVERLAPPING_OPERATOR_
+
+#include "utils.hpp"
+
+#include <algorithm>
+#include <vector>
+
+#include <Kokkos_Core.hpp>
+#include <KokkosSparse_spmv.hpp>
+
+#include <Teuchos_Comm.hpp>
+#include <Teuchos_RCP.hpp>
+#include <Teuchos_TestForException.hpp>
+#include <Teuchos_Time.hpp>
+
+#include <Tpetra_CrsMatrix.hpp>
+#include <Tpetra_Import.hpp>
+#include <Tpetra_Map.hpp>
+#include <Tpetra_MultiVector.hpp>
+#include <Tpetra_Operator.hpp>
+
+/* Apply a Tpetra::CrsMatrix with the halo exchange overlapped by the interior SpMV.
+ *
+ * The local rows are split into interior rows, which only reference columns owned by
+ * this rank, and boundary rows, which reference at least one halo column. apply()
+ * starts the Import of the halo with beginImport(), which copies the owned entries
+ * into the column map vector and posts the nonblocking sends and receives. The
+ * interior rows are multiplied while the messages are in flight, then endImport()
+ * waits for the halo and the boundary rows are multiplied.
+ *
+ * Both parts are stored as local matrices with all local rows, where the rows of the
+ * other part are empty. The values are copied from the matrix at construction, i.e.
+ * later changes of the matrix values are not seen by the operator.
+ *
+ * The interior SpMV is fenced before endImport(), such that unfinished interior work is
+ * not counted as communication on device backends.
+ */
+class OverlappingCrsOperator : public Tpetra::Operator<Scalar,LocalOrdinal,GlobalOrdinal,Node> {
+public:
+  using crs_matrix_type = Tpetra::CrsMatrix<Scalar,LocalOrdinal,GlobalOrdinal,Node>;
+  using map_type = Tpetra::Map<LocalOrdinal,GlobalOrdinal,Node>;
+  using multivec_type = Tpetra::MultiVector<Scalar,LocalOrdinal,GlobalOrdinal,Node>;
+  using import_type = Tpetra::Import<LocalOrdinal,GlobalOrdinal,Node>;
+  using local_matrix_type = typename crs_matrix_type::local_matrix_device_type;
+
+  OverlappingCrsOperator(RCP<const crs_matrix_type> A)
+    : A_(A), importer_(A->getGraph()->getImporter()),
+      commTimer_("Overlapped Import"), interiorTimer_("Interior SpMV"), boundaryTimer_("Boundary SpMV")
+  {
+    if (importer_.is_null()) return; // No halo: apply() falls back to the matrix
+
+    // Halo columns of the column map
+    const LocalOrdinal numCols = A->getColMap()->getLocalNumElements();
+    std::vector<bool> isHalo(numCols, false);
+    for (const LocalOrdinal lid : importer_->getRemoteLIDs())
+      isHalo[lid] = true;
+
+    const auto lclMatrix = A->getLocalMatrixHost();
+    const LocalOrdinal numRows = lclMatrix.numRows();
+    std::vector<bool> isBoundaryRow(numRows, false);
+    for (LocalOrdinal i = 0; i < numRows; ++i) {
+      for (auto k = lclMatrix.graph.row_map(i); k < lclMatrix.graph.row_map(i + 1); ++k) {
+        if (isHalo[lclMatrix.graph.entries(k)]) {
+          isBoundaryRow[i] = true;
+          ++numBoundaryRows_;
+          break;
+        }
+      }
+    }
+
+    interior_ = extractRows(lclMatrix, numCols, isBoundaryRow, false);
+    boundary_ = extractRows(lclMatrix, numCols, isBoundaryRow, true);
+  }
+
+  RCP<const map_type> getDomainMap() const override { return A_->getDomainMap(); }
+  RCP<const map_type> getRangeMap() const override { return A_->getRangeMap(); }
+  bool hasTransposeApply() const override { return A_->hasTransposeApply(); }
+
+  // Y = beta*Y + alpha*A*X
+  void apply(const multivec_type& X, multivec_type& Y, Teuchos::ETransp mode = Teuchos::NO_TRANS,
+      Scalar alpha = Teuchos::ScalarTraits<Scalar>::one(), Scalar beta = Teuchos::ScalarTraits<Scalar>::zero()) const override
+  {
+    if (importer_.is_null() || mode != Teuchos::NO_TRANS) {
+      A_->apply(X, Y, mode, alpha, beta);
+      return;
+    }
+
+    const size_t numVecs = X.getNumVectors();
+    if (colX_.is_null() || colX_->getNumVectors() != numVecs)
+      colX_ = rcp(new multivec_type(A_->getColMap(), numVecs, false));
+    ++numApplies_;
+
+    // The local view of a column subview with non-constant stride covers the columns of
+    // the underlying multivector, so such a Y is computed in a constant-stride copy
+    multivec_type* constY = &Y;
+    if (!Y.isConstantStride()) {
+      if (constY_.is_null() || constY_->getNumVectors() != numVecs)
+        constY_ = rcp(new multivec_type(Y.getMap(), numVecs, false));
+      if (beta != Teuchos::ScalarTraits<Scalar>::zero())
+        Tpetra::deep_copy(*constY_, Y);
+      constY = constY_.get();
+    }
+
+    // Owned entries are available after beginImport(), the halo is in flight
+    commTimer_.start(false);
+    colX_->beginImport(X, *importer_, Tpetra::INSERT);
+    commTimer_.stop();
+
+    interiorTimer_.start(false);
+    {
+      const auto x = colX_->getLocalViewDevice(Tpetra::Access::ReadOnly);
+      const auto y = constY->getLocalViewDevice(Tpetra::Access::ReadWrite);
+      KokkosSparse::spmv("N", alpha, interior_, x, beta, y);
+    }
+    // On device backends, the kernel only completes here
+    Kokkos::fence();
+    interiorTimer_.stop();
+
+    commTimer_.start(false);
+    colX_->endImport(X, *importer_, Tpetra::INSERT);
+    commTimer_.stop();
+
+    boundaryTimer_.start(false);
+    {
+      const auto x = colX_->getLocalViewDevice(Tpetra::Access::ReadOnly);
+      const auto y = constY->getLocalViewDevice(Tpetra::Access::ReadWrite);
+      KokkosSparse::spmv("N", alpha, boundary_, x, Teuchos::ScalarTraits<Scalar>::one(), y);
+    }
+    Kokkos::fence();
+    boundaryTimer_.stop();
+
+    if (constY != &Y)
+      Tpetra::deep_copy(Y, *constY);
+  }
+
+  // Number of local rows referencing halo columns
+  size_t getNumBoundaryRows() const { return numBoundaryRows_; }
+
+  // Number of applications and accumulated times on this rank. The communication time
+  // is the time spent in beginImport() and endImport(), i.e. the time not hidden.
+  int getNumApplies() const { return numApplies_; }
+  double getCommTime() const { return commTimer_.totalElapsedTime(); }
+  double getInteriorTime() const { return interiorTimer_.totalElapsedTime(); }
+  double getBoundaryTime() const { return boundaryTimer_.totalElapsedTime(); }
+
+  // Time of a blocking Import of the halo of numVecs vectors on this rank, averaged over numImports
+  double timeBlockingImport(const size_t numVecs, const int numImports) const
+  {
+    if (importer_.is_null()) return 0.0;
+    multivec_type X(A_->getDomainMap(), numVecs);
+    multivec_type colX(A_->getColMap(), numVecs, false);
+    Teuchos::Time timer("Blocking Import");
+    colX.doImport(X, *importer_, Tpetra::INSERT); // warm-up
+    A_->getComm()->barrier();
+    timer.start(true);
+    for (int i = 0; i < numImports; ++i)
+      colX.doImport(X, *importer_, Tpetra::INSERT);
+    Kokkos::fence();
+    timer.stop();
+    return timer.totalElapsedTime() / numImports;
+  }
+
+private:
+  // Local matrix with the boundary rows (or the interior rows) of lclMatrix, other rows are empty
+  template <class host_matrix_type>
+  static local_matrix_type extractRows(const host_matrix_type& lclMatrix, const LocalOrdinal numCols,
+      const std::vector<bool>& isBoundaryRow, const bool boundary)
+  {
+    using row_offsets_type = typename local_matrix_type::row_map_type::non_const_type;
+    using col_indices_type = typename local_matrix_type::index_type::non_const_type;
+    using values_type = typename local_matrix_type::values_type::non_const_type;
+
+    const LocalOrdinal numRows = lclMatrix.numRows();
+    row_offsets_type rowOffsets("row offsets", numRows + 1);
+    auto hostRowOffsets = Kokkos::create_mirror_view(rowOffsets);
+    hostRowOffsets(0) = 0;
+    for (LocalOrdinal i = 0; i < numRows; ++i) {
+      const auto rowLength = lclMatrix.graph.row_map(i + 1) - lclMatrix.graph.row_map(i);
+      hostRowOffsets(i + 1) = hostRowOffsets(i) + (isBoundaryRow[i] == boundary ? rowLength : 0);
+    }
+    const size_t numEntries = hostRowOffsets(numRows);
+
+    col_indices_type colIndices(Kokkos::view_alloc(Kokkos::WithoutInitializing, "column indices"), numEntries);
+    values_type values(Kokkos::view_alloc(Kokkos::WithoutInitializing, "values"), numEntries);
+    auto hostColIndices = Kokkos::create_mirror_view(colIndices);
+    auto hostValues = Kokkos::create_mirror_view(values);
+    for (LocalOrdinal i = 0; i < numRows; ++i) {
+      if (isBoundaryRow[i] != boundary) continue;
+      auto pos = hostRowOffsets(i);
+      for (auto k = lclMatrix.graph.row_map(i); k < lclMatrix.graph.row_map(i + 1); ++k, ++pos) {
+        hostColIndices(pos) = lclMatrix.graph.entries(k);
+        hostValues(pos) = lclMatrix.values(k);
+      }
+    }
+    Kokkos::deep_copy(rowOffsets, hostRowOffsets);
+    Kokkos::deep_copy(colIndices, hostColIndices);
+    Kokkos::deep_copy(values, hostValues);
+
+    return local_matrix_type(boundary ? "boundary rows" : "interior rows", numRows, numCols, numEntries,
+        values, rowOffsets, colIndices);
+  }
+
+  RCP<const crs_matrix_type> A_;
+  RCP<const import_type> importer_;
+  local_matrix_type interior_;
+  local_matrix_type boundary_;
+  size_t numBoundaryRows_ = 0;
+  mutable RCP<multivec_type> colX_;
+  mutable RCP<multivec_type> constY_;
+
+  mutable int numApplies_ = 0;
+  mutable Teuchos::Time commTimer_;
+  mutable Teuchos::Time interiorTimer_;
+  mutable Teuchos::Time boundaryTimer_;
+};
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef _PROFILING_OPERATOR_
+#define _PROFILING_OPERATOR_
+
+#include "utils.hpp"
+
+#include <string>
+
+#include <Kokkos_Core.hpp>
+
+#include <Teuchos_RCP.hpp>
+
+#include <Tpetra_Map.hpp>
+#include <Tpetra_MultiVector.hpp>
+#include <Tpetra_Operator.hpp>
+
+/* Label every application of an operator as a Kokkos profiling region.
+ *
+ * Belos only sees the operator interface, so the kernels launched by the wrapped
+ * operator (e.g. the SpMV of a Tpetra::CrsMatrix or the sweeps of an Ifpack2
+ * preconditioner) are attributed to this region by Kokkos Tools such as the
+ * space-time-stack tool. Without a tool loaded via KOKKOS_TOOLS_LIBS, pushing and
+ * popping regions does nothing.
+ */
+class ProfilingOperator : public Tpetra::Operator<Scalar,LocalOrdinal,GlobalOrdinal,Node> {
+public:
+  using map_type = Tpetra::Map<LocalOrdinal,GlobalOrdinal,Node>;
+  using multivec_type = Tpetra::MultiVector<Scalar,LocalOrdinal,GlobalOrdinal,Node>;
+  using operator_type = Tpetra::Operator<Scalar,LocalOrdinal,GlobalOrdinal,Node>;
+
+  ProfilingOperator(RCP<const operator_type> op, const std::string& regionName)
+    : op_(op), regionName_(regionName)
+  {}
+
+  RCP<const map_type> getDomainMap() const override { return op_->getDomainMap(); }
+  RCP<const map_type> getRangeMap() const override { return op_->getRangeMap(); }
+  bool hasTransposeApply() const override { return op_->hasTransposeApply(); }
+
+  void apply(const multivec_type& X, multivec_type& Y, Teuchos::ETransp mode = Teuchos::NO_TRANS,
+      Scalar alpha = Teuchos::ScalarTraits<Scalar>::one(), Scalar beta = Teuchos::ScalarTraits<Scalar>::zero()) const override
+  {
+    Kokkos::Profiling::pushRegion(regionName_);
+    op_->apply(X, Y, mode, alpha, beta);
+    Kokkos::Profiling::popRegion();
+  }
+
+private:
+  RCP<const operator_type> op_;
+  std::string regionName_;
+};
+
+#endif
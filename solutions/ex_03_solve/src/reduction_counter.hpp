@@ -0,0 +1,51 @@
+#ifndef _REDUCTION_COUNTER_
+#define _REDUCTION_COUNTER_
+
+/* Count the global reductions issued by this process.
+ *
+ * MPI_Allreduce and MPI_Iallreduce are intercepted through the MPI profiling
+ * interface: the definitions below take precedence over the ones of the MPI
+ * library, count the call and forward it to PMPI_Allreduce resp. PMPI_Iallreduce.
+ * This header must be included in exactly one translation unit of the executable.
+ */
+
+#include <Teuchos_config.h>
+
+#ifdef HAVE_MPI
+#include <mpi.h>
+#endif
+
+namespace ReductionCounter {
+
+inline long& count()
+{
+  static long numReductions = 0;
+  return numReductions;
+}
+
+inline void reset() { count() = 0; }
+
+inline long get() { return count(); }
+
+} // namespace ReductionCounter
+
+#ifdef HAVE_MPI
+extern "C" {
+
+int MPI_Allreduce(const void* sendbuf, void* recvbuf, int count, MPI_Datatype datatype, MPI_Op op, MPI_Comm comm)
+{
+  ++ReductionCounter::count();
+  return PMPI_Allreduce(sendbuf, recvbuf, count, datatype, op, comm);
+}
+
+int MPI_Iallreduce(const void* sendbuf, void* recvbuf, int count, MPI_Datatype datatype, MPI_Op op, MPI_Comm comm,
+    MPI_Request* request)
+{
+  ++ReductionCounter::count();
+  return PMPI_Iallreduce(sendbuf, recvbuf, count, datatype, op, comm, request);
+}
+
+}
+#endif
+
+#endif
@@ -0,0 +1,181 @@
+// SpMV/SpMM microbenchmark for the Galeri operators of ex_03
+//
+// For every matrix type, A->apply() is timed for 1 to maxNumVectors vectors and split
+// into the Import of the halo (off-rank entries of x) and the local SpMV kernel. The
+// achieved bandwidth is compared against a STREAM triad measured with Kokkos.
+
+#include "utils.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <Kokkos_Core.hpp>
+
+#include <Teuchos_CommandLineProcessor.hpp>
+#include <Teuchos_CommHelpers.hpp>
+#include <Teuchos_FancyOStream.hpp>
+#include <Teuchos_ParameterList.hpp>
+#include <Teuchos_RCP.hpp>
+#include <Teuchos_Time.hpp>
+
+#include <Tpetra_Core.hpp>
+#include <Tpetra_CrsMatrix.hpp>
+#include <Tpetra_Import.hpp>
+#include <Tpetra_MultiVector.hpp>
+
+/* Measure the STREAM triad bandwidth a = b + s * c in GB/s aggregated over all ranks.
+ *
+ * Every rank runs the triad on arrays of arraySize doubles at the same time. As in
+ * STREAM, the best of numRepeats runs is taken and 3 * 8 bytes per entry are counted.
+ */
+double measureStreamBandwidth(const size_t arraySize, const int numRepeats, const Teuchos::Comm<int>& comm)
+{
+  Kokkos::View<double*> a("a", arraySize), b("b", arraySize), c("c", arraySize);
+  Kokkos::deep_copy(b, 1.0);
+  Kokkos::deep_copy(c, 2.0);
+  const double s = 3.0;
+
+  double bestTime = -1.0;
+  Teuchos::Time timer("STREAM triad");
+  for (int k = 0; k <= numRepeats; ++k) {
+    comm.barrier();
+    timer.start(true);
+    Kokkos::parallel_for("STREAM triad", arraySize, KOKKOS_LAMBDA(const size_t i) { a(i) = b(i) + s * c(i); });
+    Kokkos::fence();
+    timer.stop();
+    if (k > 0 && (bestTime < 0.0 || timer.totalElapsedTime() < bestTime)) // k = 0 is the warm-up
+      bestTime = timer.totalElapsedTime();
+  }
+
+  const double bytes = 3.0 * sizeof(double) * arraySize * comm.getSize();
+  return bytes / getMaxTime(bestTime, comm) * 1.0e-9;
+}
+
+int main(int argc, char *argv[]) {
+  using Teuchos::ParameterList;
+  using Teuchos::RCP;
+  using Teuchos::rcp;
+
+  using scalar_type = Tpetra::MultiVector<>::scalar_type;
+  using local_ordinal_type = Tpetra::MultiVector<>::local_ordinal_type;
+  using global_ordinal_type = Tpetra::MultiVector<>::global_ordinal_type;
+  using node_type = Tpetra::MultiVector<>::node_type;
+
+  using crs_matrix_type = Tpetra::CrsMatrix<scalar_type, local_ordinal_type, global_ordinal_type, node_type>;
+  using multivec_type = Tpetra::MultiVector<scalar_type, local_ordinal_type, global_ordinal_type, node_type>;
+  using offset_type = crs_matrix_type::local_matrix_device_type::size_type;
+
+  // Never create Tpetra objects at main() scope.
+  Tpetra::ScopeGuard tpetraScope(&argc, &argv);
+
+  // Read input parameters from command line
+  Teuchos::CommandLineProcessor clp;
+  std::string matrixTypes = "Laplace1D,Laplace2D,Laplace3D,Elasticity2D,Elasticity3D"; clp.setOption("matrixTypes", &matrixTypes, "Comma-separated list of Galeri matrix types (default: all)");
+  global_ordinal_type numNodes = 1000000; clp.setOption("numNodes", &numNodes, "Number of mesh nodes; nx = ny (= nz) are chosen such that 1D, 2D and 3D meshes have about this size (default: 1000000)");
+  int maxNumVectors = 8; clp.setOption("maxNumVectors", &maxNumVectors, "Largest number of vectors in SpMM; 1 to maxNumVectors vectors are measured (default: 8)");
+  int numApplies = 100; clp.setOption("numApplies", &numApplies, "Number of timed applications per measurement (default: 100)");
+  int streamSize = 1 << 25; clp.setOption("streamSize", &streamSize, "Number of doubles per array and rank of the STREAM triad (default: 2^25)");
+
+  switch (clp.parse(argc, argv)) {
+    case Teuchos::CommandLineProcessor::PARSE_HELP_PRINTED:        return EXIT_SUCCESS;
+    case Teuchos::CommandLineProcessor::PARSE_ERROR:
+    case Teuchos::CommandLineProcessor::PARSE_UNRECOGNIZED_OPTION: return EXIT_FAILURE;
+    case Teuchos::CommandLineProcessor::PARSE_SUCCESSFUL:          break;
+  }
+
+  {
+    RCP<const Teuchos::Comm<int>> comm = Tpetra::getDefaultComm();
+    const int numProcs = comm->getSize();
+
+    RCP<Teuchos::FancyOStream> out = Teuchos::fancyOStream(Teuchos::rcpFromRef(std::cout));
+    out->setOutputToRootOnly(0);
+
+    *out << "Number of ranks: " << numProcs << ", Kokkos execution space: " << Kokkos::DefaultExecutionSpace::name()
+        << " (concurrency: " << Kokkos::DefaultExecutionSpace().concurrency() << ")" << std::endl;
+
+    const double streamBandwidth = measureStreamBandwidth(streamSize, 10, *comm);
+    *out << "STREAM triad bandwidth: " << streamBandwidth << " GB/s" << std::endl;
+
+    // Minimal memory traffic of an SpMV: every matrix entry, row offset and vector
+    // entry (including the halo) is moved once; y is written without being read.
+    *out << "matrixType,ranks,rows,entries,vectors,apply [s],import [s],local SpMV [s],GB/s,GFLOP/s,% of STREAM" << std::endl;
+
+    std::istringstream typeList(matrixTypes);
+    std::string matrixType;
+    while (std::getline(typeList, matrixType, ',')) {
+      const std::string gridType = getGridType(matrixType);
+      global_ordinal_type nx = numNodes, ny = 1, nz = 1;
+      if (gridType == "Cartesian2D") {
+        nx = ny = std::max<global_ordinal_type>(std::lround(std::sqrt(static_cast<double>(numNodes))), 1);
+      } else if (gridType == "Cartesian3D") {
+        nx = ny = nz = std::max<global_ordinal_type>(std::lround(std::cbrt(static_cast<double>(numNodes))), 1);
+      }
+      global_ordinal_type mx = -1, my = -1, mz = -1;
+      computeProcessGrid(gridType, numProcs, nx, ny, nz, mx, my, mz);
+
+      ParameterList galeriList;
+      galeriList.set("nx", nx);
+      galeriList.set("ny", ny);
+      galeriList.set("nz", nz);
+      galeriList.set("mx", mx);
+      galeriList.set("my", my);
+      galeriList.set("mz", mz);
+      galeriList.set("matrixType", matrixType);
+      RCP<const crs_matrix_type> A = buildMatrix(galeriList, comm);
+      RCP<const Tpetra::Import<local_ordinal_type, global_ordinal_type, node_type>> importer = A->getGraph()->getImporter();
+
+      for (int numVectors = 1; numVectors <= maxNumVectors; ++numVectors) {
+        multivec_type X(A->getDomainMap(), numVectors);
+        multivec_type Y(A->getRangeMap(), numVectors);
+        X.randomize();
+
+        // Complete apply including the halo exchange
+        const double applyTime = timeApply(*A, X, Y, numApplies, *comm) / numApplies;
+
+        // Halo exchange and local kernel separately. Without Import, X is already
+        // distributed like the column map.
+        RCP<multivec_type> XCol = rcp(&X, false);
+        double importTime = 0.0;
+        if (!importer.is_null()) {
+          XCol = rcp(new multivec_type(A->getColMap(), numVectors));
+          Teuchos::Time importTimer("Import");
+          XCol->doImport(X, *importer, Tpetra::INSERT); // warm-up
+          comm->barrier();
+          importTimer.start(true);
+          for (int i = 0; i < numApplies; ++i)
+            XCol->doImport(X, *importer, Tpetra::INSERT);
+          Kokkos::fence();
+          importTimer.stop();
+          importTime = getMaxTime(importTimer, *comm) / numApplies;
+        }
+        Teuchos::Time localTimer("Local SpMV");
+        A->localApply(*XCol, Y, Teuchos::NO_TRANS, 1.0, 0.0); // warm-up
+        comm->barrier();
+        localTimer.start(true);
+        for (int i = 0; i < numApplies; ++i)
+          A->localApply(*XCol, Y, Teuchos::NO_TRANS, 1.0, 0.0);
+        Kokkos::fence();
+        localTimer.stop();
+        const double localTime = getMaxTime(localTimer, *comm) / numApplies;
+
+        const double lclBytes = A->getLocalNumEntries() * (sizeof(scalar_type) + sizeof(local_ordinal_type))
+            + (A->getLocalNumRows() + 1) * sizeof(offset_type)
+            + numVectors * (A->getColMap()->getLocalNumElements() + A->getLocalNumRows()) * sizeof(scalar_type);
+        double bytes = 0.0;
+        Teuchos::reduceAll(*comm, Teuchos::REDUCE_SUM, lclBytes, Teuchos::outArg(bytes));
+        const double flops = 2.0 * A->getGlobalNumEntries() * numVectors;
+        const double bandwidth = bytes / applyTime * 1.0e-9;
+
+        *out << matrixType << "," << numProcs << "," << A->getGlobalNumRows() << "," << A->getGlobalNumEntries() << ","
+            << numVectors << "," << applyTime << "," << importTime << "," << localTime << "," << bandwidth << ","
+            << flops / applyTime * 1.0e-9 << "," << 100.0 * bandwidth / streamBandwidth << std::endl;
+      }
+    }
+
+    return EXIT_SUCCESS;
+  }
+}
@@ -2,6 +2,10 @@
 #ifndef _UTILS_
 #define _UTILS_
 
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <sstream>
 #include <string>
 
 #include <Galeri_XpetraProblemFactory.hpp>
@@ -10,10 +14,27 @@
 #include <Galeri_XpetraUtils.hpp>
 #include <Galeri_XpetraMaps.hpp>
 
+#include <Ifpack2_ILUT.hpp>
+#include <Ifpack2_LocalFilter.hpp>
+#include <Ifpack2_Preconditioner.hpp>
+#include <Ifpack2_RILUK.hpp>
+
+#include <Kokkos_Core.hpp>
+
+#include <Teuchos_Array.hpp>
 #include <Teuchos_Comm.hpp>
+#include <Teuchos_CommHelpers.hpp>
 #include <Teuchos_RCP.hpp>
+#include <Teuchos_Time.hpp>
+#include <Teuchos_TimeMonitor.hpp>
 
+#include <Tpetra_BlockCrsMatrix.hpp>
+#include <Tpetra_CrsGraph.hpp>
 #include <Tpetra_CrsMatrix.hpp>
+#include <Tpetra_Import.hpp>
+#include <Tpetra_Map.hpp>
+#include <Tpetra_MultiVector.hpp>
+#include <Tpetra_Operator.hpp>
 #include <Tpetra_Vector.hpp>
 
 #include <Xpetra_CrsMatrix.hpp>
@@ -23,6 +44,13 @@
 #include <Xpetra_Matrix.hpp>
 #include <Xpetra_MultiVector.hpp>
 #include <Xpetra_TpetraCrsMatrix.hpp>
+#include <Xpetra_TpetraMultiVector.hpp>
+
+#include <Zoltan2_OrderingProblem.hpp>
+#include <Zoltan2_PartitioningProblem.hpp>
+#include <Zoltan2_XpetraCrsGraphAdapter.hpp>
+#include <Zoltan2_XpetraMultiVectorAdapter.hpp>
+#include <Zoltan2_XpetraRowGraphAdapter.hpp>
 
 using Scalar = Tpetra::CrsMatrix<>::scalar_type;
 using LocalOrdinal = Tpetra::CrsMatrix<>::local_ordinal_type;
@@ -32,6 +60,66 @@ using Node = Tpetra::CrsMatrix<>::node_type;
 using Teuchos::RCP;
 using Teuchos::rcp;
 
+// Galeri grid type of the node map for a given matrix type
+std::string getGridType(const std::string& matrixType)
+{
+  if (matrixType == "Laplace1D") {
+    return "Cartesian1D";
+  } else if (matrixType == "Laplace2D" || matrixType == "Star2D" ||
+             matrixType == "BigStar2D" || matrixType == "Elasticity2D") {
+    return "Cartesian2D";
+  } else if (matrixType == "Laplace3D" || matrixType == "Brick3D" || matrixType == "Elasticity3D") {
+    return "Cartesian3D";
+  }
+  return "";
+}
+
+// Number of degrees of freedom per mesh node for a given matrix type
+int getNumDofsPerNode(const std::string& matrixType)
+{
+  if (matrixType == "Elasticity2D") {
+    return 2;
+  } else if (matrixType == "Elasticity3D") {
+    return 3;
+  }
+  return 1;
+}
+
+/* Choose the process grid mx * my * mz = numProcs for a Cartesian grid of nx * ny * nz nodes.
+ *
+ * Among all factorizations of the number of ranks with at most as many ranks as
+ * nodes in each direction, the one with the smallest total area of the interfaces
+ * between the subdomains, i.e. the smallest halo volume, is chosen. Striping in
+ * x-direction is the fallback if no such factorization exists.
+ */
+void computeProcessGrid(const std::string& gridType, const int numProcs,
+    const GlobalOrdinal nx, const GlobalOrdinal ny, const GlobalOrdinal nz,
+    GlobalOrdinal& mx, GlobalOrdinal& my, GlobalOrdinal& mz)
+{
+  const bool is3D = (gridType == "Cartesian3D");
+  const bool is2D = (gridType == "Cartesian2D");
+
+  mx = numProcs; my = 1; mz = 1;
+  double minInterface = -1.0;
+  for (GlobalOrdinal px = 1; px <= numProcs; ++px) {
+    if (numProcs % px != 0) continue;
+    for (GlobalOrdinal py = 1; py <= numProcs / px; ++py) {
+      if ((numProcs / px) % py != 0) continue;
+      const GlobalOrdinal pz = numProcs / (px * py);
+      if ((!is2D && !is3D && (py > 1 || pz > 1)) || (is2D && pz > 1)) continue;
+      if (px > nx || py > ny || (is3D && pz > nz)) continue;
+
+      const double interface = (is3D)
+        ? (px - 1.0) * ny * nz + (py - 1.0) * nx * nz + (pz - 1.0) * nx * ny
+        : (px - 1.0) * ny + (py - 1.0) * nx;
+      if (minInterface < 0.0 || interface < minInterface) {
+        minInterface = interface;
+        mx = px; my = py; mz = pz;
+      }
+    }
+  }
+}
+
 RCP<const Tpetra::CrsMatrix<Scalar,LocalOrdinal,GlobalOrdinal,Node>>
 buildMatrix(Teuchos::ParameterList& galeriList, RCP<const Teuchos::Comm<int>> comm)
 {
@@ -42,6 +130,10 @@ buildMatrix(Teuchos::ParameterList& galeriList, RCP<const Teuchos::Comm<int>> co
 
   using crs_matrix_type = Tpetra::CrsMatrix<>;
 
+  // Registered once, since the matrix may be built repeatedly
+  static RCP<Teuchos::Time> galeriTimer = Teuchos::TimeMonitor::getNewCounter("ex_03: Galeri build");
+  Teuchos::TimeMonitor galeriMonitor(*galeriTimer);
+
   Xpetra::UnderlyingLib lib = Xpetra::UseTpetra ;
 
   const GlobalOrdinal nx = galeriList.get<GlobalOrdinal>("nx");
@@ -51,26 +143,11 @@ buildMatrix(Teuchos::ParameterList& galeriList, RCP<const Teuchos::Comm<int>> co
   const std::string matrixType = galeriList.get<std::string>("matrixType");
 
   // Create the node map
-  std::string gridType = "";
-  if (matrixType == "Laplace1D") {
-    gridType = "Cartesian1D";
-  } else if (matrixType == "Laplace2D" || matrixType == "Star2D" ||
-             matrixType == "BigStar2D" || matrixType == "Elasticity2D") {
-    gridType = "Cartesian2D";
-  } else if (matrixType == "Laplace3D" || matrixType == "Brick3D" || matrixType == "Elasticity3D") {
-    gridType = "Cartesian3D";
-  }
+  const std::string gridType = getGridType(matrixType);
   RCP<const XMap> nodeMap = Galeri::Xpetra::CreateMap<LocalOrdinal,GlobalOrdinal,Node>(lib, gridType, comm, galeriList);
 
   // Expand map to do multiple DOF per node for block problems
-  int numDofsPerNode = 0;
-  if (matrixType == "Elasticity2D") {
-    numDofsPerNode = 2;
-  } else if (matrixType == "Elasticity3D") {
-    numDofsPerNode = 3;
-  } else {
-    numDofsPerNode = 1;
-  }
+  const int numDofsPerNode = getNumDofsPerNode(matrixType);
   RCP<const XMap> dofMap = Xpetra::MapFactory<LocalOrdinal,GlobalOrdinal,Node>::Build(nodeMap, numDofsPerNode);
 
   // Set meaningful boundary conditions in case of elasticity problems
@@ -90,20 +167,478 @@ buildMatrix(Teuchos::ParameterList& galeriList, RCP<const Teuchos::Comm<int>> co
   return tpetraCrsMatrix->getTpetra_CrsMatrix();
 }
 
+/* Build the near nullspace and the node coordinates of the Galeri problem.
+ *
+ * Both are needed by algebraic multigrid: the nullspace (constant for Laplace,
+ * rigid body modes for elasticity) defines the coarse space, the coordinates can
+ * be used for aggregation and repartitioning. Must be called after buildMatrix(),
+ * since the latter sets the boundary conditions of the elasticity problems in
+ * galeriList.
+ */
+void buildNullspaceAndCoordinates(Teuchos::ParameterList& galeriList, RCP<const Teuchos::Comm<int>> comm,
+    RCP<Tpetra::MultiVector<Scalar,LocalOrdinal,GlobalOrdinal,Node>>& nullspace,
+    RCP<Tpetra::MultiVector<typename Teuchos::ScalarTraits<Scalar>::coordinateType,LocalOrdinal,GlobalOrdinal,Node>>& coordinates)
+{
+  using Coordinate = typename Teuchos::ScalarTraits<Scalar>::coordinateType;
+  using XTeptraCrsMatrix = Xpetra::TpetraCrsMatrix<Scalar,LocalOrdinal,GlobalOrdinal,Node>;
+  using XMap = Xpetra::Map<LocalOrdinal,GlobalOrdinal,Node>;
+  using XMultiVector = Xpetra::MultiVector<Scalar,LocalOrdinal,GlobalOrdinal,Node>;
+  using XCoordMultiVector = Xpetra::MultiVector<Coordinate,LocalOrdinal,GlobalOrdinal,Node>;
+  using XTpetraMultiVector = Xpetra::TpetraMultiVector<Scalar,LocalOrdinal,GlobalOrdinal,Node>;
+  using XTpetraCoordMultiVector = Xpetra::TpetraMultiVector<Coordinate,LocalOrdinal,GlobalOrdinal,Node>;
+
+  Xpetra::UnderlyingLib lib = Xpetra::UseTpetra;
+
+  const std::string matrixType = galeriList.get<std::string>("matrixType");
+  const std::string gridType = getGridType(matrixType);
+
+  // Same node and dof map as in buildMatrix()
+  RCP<const XMap> nodeMap = Galeri::Xpetra::CreateMap<LocalOrdinal,GlobalOrdinal,Node>(lib, gridType, comm, galeriList);
+  RCP<const XMap> dofMap = Xpetra::MapFactory<LocalOrdinal,GlobalOrdinal,Node>::Build(nodeMap, getNumDofsPerNode(matrixType));
+
+  // Coordinates of the mesh nodes ("1D", "2D", or "3D")
+  RCP<XCoordMultiVector> xCoordinates =
+    Galeri::Xpetra::Utils::CreateCartesianCoordinates<Coordinate,LocalOrdinal,GlobalOrdinal,XMap,XCoordMultiVector>(
+      gridType.substr(9), nodeMap, galeriList);
+  coordinates = Teuchos::rcp_dynamic_cast<XTpetraCoordMultiVector>(xCoordinates, true)->getTpetra_MultiVector();
+
+  RCP<Galeri::Xpetra::Problem<XMap,XTeptraCrsMatrix,XMultiVector> > problem =
+    Galeri::Xpetra::BuildProblem<Scalar,LocalOrdinal,GlobalOrdinal,XMap,XTeptraCrsMatrix,XMultiVector>(matrixType, dofMap, galeriList);
+  RCP<XMultiVector> xNullspace = problem->BuildNullspace();
+  nullspace = Teuchos::rcp_dynamic_cast<XTpetraMultiVector>(xNullspace, true)->getTpetra_MultiVector();
+}
+
+// Pseudo-random value in [-1, 1) of entry gid of vector j of the exact solution
+KOKKOS_INLINE_FUNCTION
+Scalar getExactSolutionValue(const GlobalOrdinal gid, const size_t j)
+{
+  // splitmix64 hash of the global index and the vector index
+  std::uint64_t z = static_cast<std::uint64_t>(gid) + 0x9E3779B97F4A7C15ull * (j + 1);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+  z = z ^ (z >> 31);
+  return static_cast<Scalar>(2.0 * static_cast<double>(z >> 11) / 9007199254740992.0 - 1.0);
+}
+
+/* Create the linear system A*x = b with exact solution xExact and zero initial guess x.
+ *
+ * In generator mode "apply", xExact is randomized and b = A*xExact is computed with
+ * an SpMV. In mode "fused", the entries of xExact are pseudo-random functions of their
+ * global index, so that the entries of the ghost columns are known on every rank:
+ * xExact and b = A*xExact are then written row by row in one kernel, without
+ * communication and without zero-filling the vectors first. This requires the same
+ * distribution of rows and domain, as for all Galeri problems.
+ */
 void createLinearSystem(Teuchos::ParameterList& galeriList, RCP<const Teuchos::Comm<int>> comm,
     RCP<const Tpetra::CrsMatrix<Scalar,LocalOrdinal,GlobalOrdinal,Node>>& A,
-    RCP<Tpetra::Vector<Scalar,LocalOrdinal,GlobalOrdinal,Node>>& x,
-    RCP<Tpetra::Vector<Scalar,LocalOrdinal,GlobalOrdinal,Node>>& b)
+    RCP<Tpetra::MultiVector<Scalar,LocalOrdinal,GlobalOrdinal,Node>>& x,
+    RCP<Tpetra::MultiVector<Scalar,LocalOrdinal,GlobalOrdinal,Node>>& b,
+    RCP<Tpetra::MultiVector<Scalar,LocalOrdinal,GlobalOrdinal,Node>>& xExact,
+    const size_t numVectors = 1, const std::string& generator = "apply")
 {
-  using Vector = Tpetra::Vector<Scalar,LocalOrdinal,GlobalOrdinal,Node>;
+  using MultiVector = Tpetra::MultiVector<Scalar,LocalOrdinal,GlobalOrdinal,Node>;
+  using execution_space = typename MultiVector::execution_space;
+  using local_map_type = typename Tpetra::Map<LocalOrdinal,GlobalOrdinal,Node>::local_map_type;
+
+  static RCP<Teuchos::Time> createTimer = Teuchos::TimeMonitor::getNewCounter("ex_03: createLinearSystem");
+  Teuchos::TimeMonitor createMonitor(*createTimer);
 
   A = buildMatrix(galeriList, comm);
-  x = rcp(new Vector(A->getDomainMap(), true));
-  b = rcp(new Vector(A->getRangeMap(),true));
+  x = rcp(new MultiVector(A->getDomainMap(), numVectors, true));
+
+  // Only the generation of xExact and b is timed separately, without building the matrix
+  static RCP<Teuchos::Time> generateTimer = Teuchos::TimeMonitor::getNewCounter("ex_03: System generation");
+  comm->barrier();
+  Teuchos::TimeMonitor generateMonitor(*generateTimer);
+
+  xExact = rcp(new MultiVector(A->getDomainMap(), numVectors, false));
+  b = rcp(new MultiVector(A->getRangeMap(), numVectors, false));
+
+  if (generator != "fused") {
+    xExact->randomize();
+    A->apply(*xExact, *b);
+    Kokkos::fence();
+    return;
+  }
+
+  auto lclA = A->getLocalMatrixDevice();
+  const local_map_type lclRowMap = A->getRowMap()->getLocalMap();
+  const local_map_type lclColMap = A->getColMap()->getLocalMap();
+  auto lclXExact = xExact->getLocalViewDevice(Tpetra::Access::OverwriteAll);
+  auto lclB = b->getLocalViewDevice(Tpetra::Access::OverwriteAll);
+  Kokkos::parallel_for("createLinearSystem::fused", Kokkos::RangePolicy<execution_space>(0, A->getLocalNumRows()),
+    KOKKOS_LAMBDA(const LocalOrdinal lclRow) {
+      const GlobalOrdinal gblRow = lclRowMap.getGlobalElement(lclRow);
+      const auto row = lclA.rowConst(lclRow);
+      for (size_t j = 0; j < numVectors; ++j) {
+        Scalar sum = 0.0;
+        for (LocalOrdinal k = 0; k < row.length; ++k)
+          sum += row.value(k) * getExactSolutionValue(lclColMap.getGlobalElement(row.colidx(k)), j);
+        lclXExact(lclRow, j) = getExactSolutionValue(gblRow, j);
+        lclB(lclRow, j) = sum;
+      }
+    });
+  Kokkos::fence();
+}
+
+// Return the maximum over all columns of the relative error ||X - XExact|| / ||XExact||
+double computeMaxRelativeError(const Tpetra::MultiVector<Scalar,LocalOrdinal,GlobalOrdinal,Node>& X,
+    const Tpetra::MultiVector<Scalar,LocalOrdinal,GlobalOrdinal,Node>& XExact)
+{
+  using magnitude_type = typename Teuchos::ScalarTraits<Scalar>::magnitudeType;
+
+  Tpetra::MultiVector<Scalar,LocalOrdinal,GlobalOrdinal,Node> E(X, Teuchos::Copy);
+  E.update(-Teuchos::ScalarTraits<Scalar>::one(), XExact, Teuchos::ScalarTraits<Scalar>::one());
+
+  Teuchos::Array<magnitude_type> errorNorms(X.getNumVectors()), exactNorms(X.getNumVectors());
+  E.norm2(errorNorms());
+  XExact.norm2(exactNorms());
+  double maxError = 0.0;
+  for (size_t j = 0; j < X.getNumVectors(); ++j)
+    maxError = std::max(maxError, static_cast<double>(errorNorms[j] / exactNorms[j]));
+  return maxError;
+}
+
+/* Update the values of the fill complete matrix in place without changing its graph.
+ *
+ * The diagonal is scaled such that it equals (1 + 0.05 * step) times the diagonal
+ * of step 0, mimicking a mass matrix term with a changing time step size.
+ */
+void updateMatrixValues(Tpetra::CrsMatrix<Scalar,LocalOrdinal,GlobalOrdinal,Node>& A, const int step)
+{
+  const Scalar factor = (1.0 + 0.05 * step) / (1.0 + 0.05 * (step - 1));
+  const auto rowMap = A.getRowMap();
+  const auto colMap = A.getColMap();
+
+  Tpetra::Vector<Scalar,LocalOrdinal,GlobalOrdinal,Node> diagonal(rowMap);
+  A.getLocalDiagCopy(diagonal);
+
+  A.resumeFill();
+  {
+    auto diagValues = diagonal.getLocalViewHost(Tpetra::Access::ReadOnly);
+    for (LocalOrdinal lclRow = 0; lclRow < static_cast<LocalOrdinal>(rowMap->getLocalNumElements()); ++lclRow) {
+      const LocalOrdinal lclCol = colMap->getLocalElement(rowMap->getGlobalElement(lclRow));
+      const Scalar value = factor * diagValues(lclRow, 0);
+      A.replaceLocalValues(lclRow, 1, &value, &lclCol);
+    }
+  }
+  A.fillComplete(A.getDomainMap(), A.getRangeMap());
+}
+
+// Return the maximum over all columns of the relative residual ||B - A*X|| / ||B||
+double computeMaxRelativeResidual(const Tpetra::Operator<Scalar,LocalOrdinal,GlobalOrdinal,Node>& A,
+    const Tpetra::MultiVector<Scalar,LocalOrdinal,GlobalOrdinal,Node>& X,
+    const Tpetra::MultiVector<Scalar,LocalOrdinal,GlobalOrdinal,Node>& B)
+{
+  using magnitude_type = typename Teuchos::ScalarTraits<Scalar>::magnitudeType;
+
+  Tpetra::MultiVector<Scalar,LocalOrdinal,GlobalOrdinal,Node> R(B.getMap(), B.getNumVectors(), false);
+  A.apply(X, R);
+  R.update(Teuchos::ScalarTraits<Scalar>::one(), B, -Teuchos::ScalarTraits<Scalar>::one());
+
+  Teuchos::Array<magnitude_type> residualNorms(B.getNumVectors()), rhsNorms(B.getNumVectors());
+  R.norm2(residualNorms());
+  B.norm2(rhsNorms());
+  double maxResidual = 0.0;
+  for (size_t j = 0; j < B.getNumVectors(); ++j)
+    maxResidual = std::max(maxResidual, static_cast<double>(residualNorms[j] / rhsNorms[j]));
+  return maxResidual;
+}
+
+// Return the maximum of a rank-local time over all ranks
+double getMaxTime(const double lclTime, const Teuchos::Comm<int>& comm)
+{
+  double gblTime = 0.0;
+  Teuchos::reduceAll<int, double>(comm, Teuchos::REDUCE_MAX, lclTime, Teuchos::outArg(gblTime));
+  return gblTime;
+}
+
+// Return the maximum of the timer's elapsed time over all ranks
+double getMaxTime(const Teuchos::Time& timer, const Teuchos::Comm<int>& comm)
+{
+  return getMaxTime(timer.totalElapsedTime(), comm);
+}
+
+// Ifpack2 preconditioner name for a given preconditioner type of this example
+std::string getIfpack2Type(const std::string& precType)
+{
+  if (precType == "Chebyshev") {
+    return "CHEBYSHEV";
+  } else if (precType == "RILUK") {
+    return "RILUK";
+  } else if (precType == "ILUT") {
+    return "ILUT";
+  } else if (precType == "Schwarz") {
+    return "SCHWARZ";
+  }
+  return "RELAXATION";
+}
+
+/* Map the solver type given on the command line to the name of the Belos solver.
+ *
+ * The communication-avoiding variants are the Tpetra-specific solvers of Belos:
+ * they trade the one global reduction per orthogonalization step of classical
+ * GMRES/CG for fewer (single-reduce, s-step) or overlapped (pipelined) reductions.
+ */
+std::string getBelosSolverName(const std::string& solverType)
+{
+  if (solverType == "Pipelined CG") {
+    return "TPETRA CG PIPELINE";
+  } else if (solverType == "Single Reduce CG") {
+    return "TPETRA CG SINGLE REDUCE";
+  } else if (solverType == "Pipelined GMRES") {
+    return "TPETRA GMRES PIPELINE";
+  } else if (solverType == "Single Reduce GMRES") {
+    return "TPETRA GMRES SINGLE REDUCE";
+  } else if (solverType == "s-step GMRES") {
+    return "TPETRA GMRES S-STEP";
+  }
+  return solverType;
+}
+
+// Set level of fill and drop tolerance of the Ifpack2 incomplete factorizations RILUK and ILUT
+void setIncompleteFactorizationParameters(const std::string& ifpack2Type, const double levelOfFill,
+    const double dropTol, Teuchos::ParameterList& params)
+{
+  if (ifpack2Type == "RILUK") {
+    params.set("fact: iluk level-of-fill", static_cast<int>(levelOfFill));
+  } else if (ifpack2Type == "ILUT") {
+    params.set("fact: ilut level-of-fill", levelOfFill);
+    params.set("fact: drop tolerance", dropTol);
+  }
+}
+
+// Return the sum over all ranks of the bytes of the local CRS arrays (offsets, column indices, values)
+double getCrsMatrixMemory(const Tpetra::CrsMatrix<Scalar,LocalOrdinal,GlobalOrdinal,Node>& A, const Teuchos::Comm<int>& comm)
+{
+  using local_matrix_type = typename Tpetra::CrsMatrix<Scalar,LocalOrdinal,GlobalOrdinal,Node>::local_matrix_device_type;
+  using offset_type = typename local_matrix_type::size_type;
+
+  const double lclBytes = (A.getLocalNumRows() + 1) * sizeof(offset_type)
+    + A.getLocalNumEntries() * (sizeof(LocalOrdinal) + sizeof(Scalar));
+  double gblBytes = 0.0;
+  Teuchos::reduceAll<int, double>(comm, Teuchos::REDUCE_SUM, lclBytes, Teuchos::outArg(gblBytes));
+  return gblBytes;
+}
+
+/* Return the sum over all ranks of the bytes of the local block CRS arrays.
+ *
+ * Only one column index is stored per dense block of blockSize x blockSize values.
+ */
+double getBlockCrsMatrixMemory(const Tpetra::BlockCrsMatrix<Scalar,LocalOrdinal,GlobalOrdinal,Node>& A, const Teuchos::Comm<int>& comm)
+{
+  using offset_type = typename Tpetra::CrsGraph<LocalOrdinal,GlobalOrdinal,Node>::local_graph_device_type::size_type;
+
+  const size_t blockSize = A.getBlockSize();
+  const size_t numBlockEntries = A.getCrsGraph().getLocalNumEntries();
+  const double lclBytes = (A.getCrsGraph().getLocalNumRows() + 1) * sizeof(offset_type)
+    + numBlockEntries * (sizeof(LocalOrdinal) + blockSize * blockSize * sizeof(Scalar));
+  double gblBytes = 0.0;
+  Teuchos::reduceAll<int, double>(comm, Teuchos::REDUCE_SUM, lclBytes, Teuchos::outArg(gblBytes));
+  return gblBytes;
+}
+
+// Apply an operator numApplies times and return the maximum time over all ranks
+double timeApply(const Tpetra::Operator<Scalar,LocalOrdinal,GlobalOrdinal,Node>& op,
+    const Tpetra::MultiVector<Scalar,LocalOrdinal,GlobalOrdinal,Node>& x,
+    Tpetra::MultiVector<Scalar,LocalOrdinal,GlobalOrdinal,Node>& y,
+    const int numApplies, const Teuchos::Comm<int>& comm)
+{
+  Teuchos::Time timer("Apply");
+  op.apply(x, y); // warm-up
+  comm.barrier();
+  timer.start(true);
+  for (int i = 0; i < numApplies; ++i)
+    op.apply(x, y);
+  Kokkos::fence();
+  timer.stop();
+  return getMaxTime(timer, comm);
+}
+
+/* Return minimum, mean and maximum over all ranks of the halo volume of the matrix.
+ *
+ * The halo volume of a rank is the number of remote entries it receives in every
+ * SpMV, i.e. the number of remote IDs of the matrix' Import.
+ */
+void getHaloVolume(const Tpetra::CrsMatrix<Scalar,LocalOrdinal,GlobalOrdinal,Node>& A, const Teuchos::Comm<int>& comm,
+    double& minVolume, double& meanVolume, double& maxVolume)
+{
+  auto importer = A.getGraph()->getImporter();
+  const double lclVolume = importer.is_null() ? 0.0 : static_cast<double>(importer->getNumRemoteIDs());
 
-  x->randomize();
-  A->apply(*x, *b);
-  x->putScalar(Teuchos::ScalarTraits<Scalar>::zero());
+  double sumVolume = 0.0;
+  Teuchos::reduceAll<int, double>(comm, Teuchos::REDUCE_MIN, lclVolume, Teuchos::outArg(minVolume));
+  Teuchos::reduceAll<int, double>(comm, Teuchos::REDUCE_MAX, lclVolume, Teuchos::outArg(maxVolume));
+  Teuchos::reduceAll<int, double>(comm, Teuchos::REDUCE_SUM, lclVolume, Teuchos::outArg(sumVolume));
+  meanVolume = sumVolume / comm.getSize();
+}
+
+/* Return the map of the mesh nodes of a dof map with numDofsPerNode consecutive dofs per node.
+ *
+ * As in Galeri, dof gid * numDofsPerNode + k belongs to node gid. All dofs of a node
+ * have to be owned by the same rank.
+ */
+RCP<const Tpetra::Map<LocalOrdinal,GlobalOrdinal,Node>>
+getNodeMap(const Tpetra::Map<LocalOrdinal,GlobalOrdinal,Node>& dofMap, const int numDofsPerNode)
+{
+  using map_type = Tpetra::Map<LocalOrdinal,GlobalOrdinal,Node>;
+
+  Teuchos::Array<GlobalOrdinal> nodeGids;
+  for (const GlobalOrdinal gid : dofMap.getLocalElementList())
+    if (gid % numDofsPerNode == 0) nodeGids.push_back(gid / numDofsPerNode);
+  return rcp(new map_type(dofMap.getGlobalNumElements() / numDofsPerNode, nodeGids(), dofMap.getIndexBase(), dofMap.getComm()));
+}
+
+/* Repartition the matrix with Zoltan2 and return it migrated to the new row distribution.
+ *
+ * The mesh nodes are partitioned, such that all dofs of a node stay on one rank:
+ * method "graph" partitions the node graph (the graph of the matrix with the dofs of
+ * a node merged) with Zoltan's hypergraph partitioner (PHG), method "geometric"
+ * partitions the node coordinates with multi-jagged coordinate bisection. The
+ * coordinates are only needed for "geometric".
+ */
+RCP<const Tpetra::CrsMatrix<Scalar,LocalOrdinal,GlobalOrdinal,Node>>
+repartitionMatrix(RCP<const Tpetra::CrsMatrix<Scalar,LocalOrdinal,GlobalOrdinal,Node>> A,
+    RCP<const Tpetra::MultiVector<typename Teuchos::ScalarTraits<Scalar>::coordinateType,LocalOrdinal,GlobalOrdinal,Node>> coordinates,
+    const std::string& method, const int numDofsPerNode)
+{
+  using crs_matrix_type = Tpetra::CrsMatrix<Scalar,LocalOrdinal,GlobalOrdinal,Node>;
+  using graph_type = Tpetra::CrsGraph<LocalOrdinal,GlobalOrdinal,Node>;
+  using map_type = Tpetra::Map<LocalOrdinal,GlobalOrdinal,Node>;
+  using coord_multivec_type = Tpetra::MultiVector<typename Teuchos::ScalarTraits<Scalar>::coordinateType,LocalOrdinal,GlobalOrdinal,Node>;
+  using graph_adapter_type = Zoltan2::XpetraCrsGraphAdapter<graph_type, coord_multivec_type>;
+  using coord_adapter_type = Zoltan2::XpetraMultiVectorAdapter<coord_multivec_type>;
+
+  // Graph of the mesh nodes
+  RCP<const graph_type> nodeGraph = A->getCrsGraph();
+  if (numDofsPerNode > 1) {
+    RCP<const map_type> nodeMap = getNodeMap(*A->getRowMap(), numDofsPerNode);
+    RCP<graph_type> graph = rcp(new graph_type(nodeMap, numDofsPerNode * A->getGlobalMaxNumRowEntries()));
+    const auto colMap = A->getColMap();
+    for (size_t i = 0; i < A->getLocalNumRows(); ++i) {
+      const GlobalOrdinal nodeGid = A->getRowMap()->getGlobalElement(i) / numDofsPerNode;
+      typename graph_type::local_inds_host_view_type lclCols;
+      A->getCrsGraph()->getLocalRowView(i, lclCols);
+      Teuchos::Array<GlobalOrdinal> nodeCols(lclCols.extent(0));
+      for (size_t k = 0; k < lclCols.extent(0); ++k)
+        nodeCols[k] = colMap->getGlobalElement(lclCols(k)) / numDofsPerNode;
+      graph->insertGlobalIndices(nodeGid, nodeCols());
+    }
+    graph->fillComplete();
+    nodeGraph = graph;
+  }
+
+  Teuchos::ParameterList params;
+  params.set("partitioning_approach", "partition");
+
+  graph_adapter_type graphAdapter(nodeGraph);
+  RCP<coord_adapter_type> coordAdapter = Teuchos::null;
+  if (method == "geometric") {
+    params.set("algorithm", "multijagged");
+    coordAdapter = rcp(new coord_adapter_type(coordinates));
+    graphAdapter.setCoordinateInput(coordAdapter.get());
+  } else {
+    params.set("algorithm", "zoltan");
+    params.sublist("zoltan_parameters").set("LB_METHOD", "HYPERGRAPH");
+  }
+
+  Zoltan2::PartitioningProblem<graph_adapter_type> problem(&graphAdapter, &params, A->getComm());
+  problem.solve();
+
+  RCP<graph_type> newNodeGraph = Teuchos::null;
+  graphAdapter.applyPartitioningSolution(*nodeGraph, newNodeGraph, problem.getSolution());
+
+  // Expand the new node distribution to the dofs and migrate the matrix
+  Teuchos::Array<GlobalOrdinal> newGids;
+  for (const GlobalOrdinal nodeGid : newNodeGraph->getRowMap()->getLocalElementList())
+    for (int k = 0; k < numDofsPerNode; ++k)
+      newGids.push_back(nodeGid * numDofsPerNode + k);
+  RCP<const map_type> newRowMap = rcp(new map_type(A->getGlobalNumRows(), newGids(), A->getRowMap()->getIndexBase(), A->getComm()));
+
+  Tpetra::Import<LocalOrdinal,GlobalOrdinal,Node> importer(A->getRowMap(), newRowMap);
+  RCP<crs_matrix_type> newA = rcp(new crs_matrix_type(newRowMap, A->getGlobalMaxNumRowEntries()));
+  newA->doImport(*A, importer, Tpetra::INSERT);
+  newA->fillComplete(newRowMap, newRowMap);
+  return newA;
+}
+
+/* Symmetrically reorder the rank-local block of the matrix and return the reordered matrix.
+ *
+ * The ordering of the local block (without the off-rank columns) is computed with
+ * Zoltan2 in the same way as Ifpack2's "schwarz: use reordering": method "rcm" is
+ * reverse Cuthill-McKee, "amd" approximate minimum degree and "metis" METIS nested
+ * dissection (the latter two require the AMD resp. METIS TPL). The rows stay on their
+ * rank. They are imported into a row map listing the GIDs of each rank in the new
+ * order, such that the local rows, the owned columns and the vector entries are
+ * stored in that order.
+ */
+RCP<const Tpetra::CrsMatrix<Scalar,LocalOrdinal,GlobalOrdinal,Node>>
+reorderMatrix(RCP<const Tpetra::CrsMatrix<Scalar,LocalOrdinal,GlobalOrdinal,Node>> A, const std::string& method)
+{
+  using crs_matrix_type = Tpetra::CrsMatrix<Scalar,LocalOrdinal,GlobalOrdinal,Node>;
+  using row_matrix_type = Tpetra::RowMatrix<Scalar,LocalOrdinal,GlobalOrdinal,Node>;
+  using row_graph_type = Tpetra::RowGraph<LocalOrdinal,GlobalOrdinal,Node>;
+  using map_type = Tpetra::Map<LocalOrdinal,GlobalOrdinal,Node>;
+  using graph_adapter_type = Zoltan2::XpetraRowGraphAdapter<row_graph_type>;
+
+  Ifpack2::LocalFilter<row_matrix_type> localA(A);
+  graph_adapter_type graphAdapter(localA.getGraph());
+
+  Teuchos::ParameterList params;
+  params.set("order_method_type", "local");
+  params.set("order_method", method == "amd" ? "minimum_degree" : method);
+  Zoltan2::OrderingProblem<graph_adapter_type> problem(&graphAdapter, &params, localA.getComm());
+  problem.solve();
+
+  // The permutation maps new to old local indices
+  Teuchos::ArrayRCP<LocalOrdinal> perm = problem.getLocalOrderingSolution()->getPermutationRCPConst();
+  Teuchos::ArrayView<const GlobalOrdinal> oldGids = A->getRowMap()->getLocalElementList();
+  Teuchos::Array<GlobalOrdinal> newGids(oldGids.size());
+  for (LocalOrdinal i = 0; i < oldGids.size(); ++i)
+    newGids[i] = oldGids[perm[i]];
+  RCP<const map_type> newRowMap = rcp(new map_type(A->getRowMap()->getGlobalNumElements(), newGids(),
+      A->getRowMap()->getIndexBase(), A->getComm()));
+
+  Tpetra::Import<LocalOrdinal,GlobalOrdinal,Node> importer(A->getRowMap(), newRowMap);
+  RCP<crs_matrix_type> newA = rcp(new crs_matrix_type(newRowMap, A->getGlobalMaxNumRowEntries()));
+  newA->doImport(*A, importer, Tpetra::INSERT);
+  newA->fillComplete(newRowMap, newRowMap);
+  return newA;
+}
+
+/* Return the fill ratio nnz(L + U) / nnz(A) of an incomplete factorization.
+ *
+ * Supported are RILUK and ILUT; for other preconditioners -1 is returned.
+ */
+double getFactorFillRatio(const Ifpack2::Preconditioner<Scalar,LocalOrdinal,GlobalOrdinal,Node>& prec,
+    const Tpetra::CrsMatrix<Scalar,LocalOrdinal,GlobalOrdinal,Node>& A)
+{
+  using row_matrix_type = Tpetra::RowMatrix<Scalar,LocalOrdinal,GlobalOrdinal,Node>;
+
+  double numFactorEntries = -1.0;
+  if (auto riluk = dynamic_cast<const Ifpack2::RILUK<row_matrix_type>*>(&prec)) {
+    // RILUK stores the diagonal separately from the strictly triangular factors
+    numFactorEntries = riluk->getL().getGlobalNumEntries() + riluk->getU().getGlobalNumEntries()
+        + A.getGlobalNumRows();
+  } else if (auto ilut = dynamic_cast<const Ifpack2::ILUT<row_matrix_type>*>(&prec)) {
+    numFactorEntries = ilut->getL()->getGlobalNumEntries() + ilut->getU()->getGlobalNumEntries();
+  }
+  return numFactorEntries < 0.0 ? -1.0 : numFactorEntries / A.getGlobalNumEntries();
+}
+
+/* Write the statistics of all timers registered with Teuchos::TimeMonitor to a YAML file.
+ *
+ * All ranks take part in computing the minimum, mean and maximum over all ranks,
+ * only rank 0 writes the file.
+ */
+void writeTimingReport(const std::string& fileName, RCP<const Teuchos::Comm<int>> comm)
+{
+  std::ostringstream report;
+  Teuchos::TimeMonitor::summarizeToYaml(comm.ptr(), report, Teuchos::YAML_FORMAT_SPACIOUS);
+  if (comm->getRank() == 0) {
+    std::ofstream file(fileName);
+    file << report.str();
+  }
 }
 
 #endif